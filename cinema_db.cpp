@@ -4,17 +4,3603 @@
 #include <pqxx/pqxx>
 #include <vector>
 #include <stdexcept>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <set>
+#include <chrono>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <future>
+#include <optional>
+#include <any>
+#include <iterator>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Реестр SQL-запросов приложения. Каждый запрос готовится на соединении
+// один раз (prepare), а проверка планов прогоняет их через EXPLAIN.
+struct StatementDef {
+    const char* name;
+    const char* sql;
+    const char* sample_args;  // аргументы для EXPLAIN
+    bool read_only;
+    // Для читающих запросов: читать ли курсором (см. QuerySpec::unbounded)
+    // и память декодированного результата
+    bool unbounded;
+    size_t (*decoded_bytes)(const pqxx::result&);
+};
+
+// Описание колонок читающих запросов на этапе компиляции. Из одной таблицы
+// колонок строятся список SELECT, типизированный декодер строки и вывод
+// с фиксированной шириной, поэтому SQL, заголовки и row[N] не расходятся.
+enum class ColumnType { Int, Count, Decimal, Money, Minutes, AvgMinutes, Text, Flag,
+                        NullableInt, NullableDecimal, NullableMinutes };
+
+struct ColumnSpec {
+    const char* name;    // имя колонки в результате
+    const char* expr;    // SQL-выражение; nullptr - колонка таблицы с тем же именем
+    const char* header;  // заголовок при выводе
+    ColumnType type;
+    int width;           // ширина при выводе; 0 - колонка не печатается
+};
+
+// Запрос отчета: колонки, текст до SELECT (with) и после списка колонок (from)
+struct QuerySpec {
+    static constexpr const char* with = "";
+    static constexpr const char* sample_args = "";
+    // Размер результата не ограничен LIMIT, агрегатом или списком ключей;
+    // такие запросы читаются курсором под бюджетом памяти вызова
+    static constexpr bool unbounded = false;
+};
+
+static std::string fixedDecimal(double value, int precision) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(precision) << value;
+    return out.str();
+}
+
+// Тип значения колонки и его текстовое представление
+template<ColumnType Type>
+struct ColumnTraits;
+
+template<>
+struct ColumnTraits<ColumnType::Int> {
+    using value_type = int;
+    static int decode(const pqxx::field& field) { return field.is_null() ? 0 : field.as<int>(); }
+    static std::string format(int value) { return std::to_string(value); }
+};
+
+template<>
+struct ColumnTraits<ColumnType::Count> {
+    using value_type = long;
+    static long decode(const pqxx::field& field) { return field.is_null() ? 0 : field.as<long>(); }
+    static std::string format(long value) { return std::to_string(value); }
+};
+
+template<>
+struct ColumnTraits<ColumnType::Decimal> {
+    using value_type = double;
+    static double decode(const pqxx::field& field) { return field.is_null() ? 0 : field.as<double>(); }
+    static std::string format(double value) { return fixedDecimal(value, 2); }
+};
+
+// Денежные суммы печатаются в миллионах; NULL (нет фильмов) - как N/A
+template<>
+struct ColumnTraits<ColumnType::Money> {
+    using value_type = std::optional<double>;
+    static std::optional<double> decode(const pqxx::field& field) {
+        if (field.is_null()) {
+            return std::nullopt;
+        }
+        return field.as<double>();
+    }
+    static std::string format(const std::optional<double>& value) {
+        return value ? "$" + fixedDecimal(*value / 1000000, 2) + "M" : "N/A";
+    }
+};
+
+template<>
+struct ColumnTraits<ColumnType::Minutes> {
+    using value_type = int;
+    static int decode(const pqxx::field& field) { return field.is_null() ? 0 : field.as<int>(); }
+    static std::string format(int value) { return std::to_string(value) + " min"; }
+};
+
+template<>
+struct ColumnTraits<ColumnType::AvgMinutes> {
+    using value_type = double;
+    static double decode(const pqxx::field& field) { return field.is_null() ? 0 : field.as<double>(); }
+    static std::string format(double value) { return fixedDecimal(value, 1) + " min"; }
+};
+
+template<>
+struct ColumnTraits<ColumnType::Text> {
+    using value_type = std::string;
+    static std::string decode(const pqxx::field& field) { return field.c_str(); }
+    static const std::string& format(const std::string& value) { return value; }
+};
+
+template<>
+struct ColumnTraits<ColumnType::Flag> {
+    using value_type = bool;
+    static bool decode(const pqxx::field& field) { return !field.is_null() && field.c_str()[0] == 't'; }
+    static std::string format(bool value) { return value ? "Yes" : "No"; }
+};
+
+// Колонка, допускающая NULL: значение - std::optional от базового типа,
+// NULL печатается пустой ячейкой, а не нулем
+template<ColumnType Base>
+struct NullableColumnTraits {
+    using value_type = std::optional<typename ColumnTraits<Base>::value_type>;
+    static value_type decode(const pqxx::field& field) {
+        if (field.is_null()) {
+            return std::nullopt;
+        }
+        return ColumnTraits<Base>::decode(field);
+    }
+    static std::string format(const value_type& value) {
+        return value ? ColumnTraits<Base>::format(*value) : "";
+    }
+};
+
+template<>
+struct ColumnTraits<ColumnType::NullableInt> : NullableColumnTraits<ColumnType::Int> {};
+
+template<>
+struct ColumnTraits<ColumnType::NullableDecimal> : NullableColumnTraits<ColumnType::Decimal> {};
+
+template<>
+struct ColumnTraits<ColumnType::NullableMinutes> : NullableColumnTraits<ColumnType::Minutes> {};
+
+// Строка фиксированной длины, собираемая в constexpr-функциях
+template<size_t N>
+struct FixedString {
+    char data[N + 1] = {};
+};
+
+constexpr size_t constLength(const char* text) {
+    size_t length = 0;
+    while (text[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+constexpr size_t constAppend(char* out, size_t pos, const char* text) {
+    for (size_t i = 0; text[i] != '\0'; i++) {
+        out[pos++] = text[i];
+    }
+    return pos;
+}
+
+constexpr bool constEqual(const char* a, const char* b) {
+    size_t i = 0;
+    while (a[i] != '\0' && a[i] == b[i]) {
+        i++;
+    }
+    return a[i] == b[i];
+}
+
+template<typename Query>
+constexpr size_t selectLength() {
+    size_t length = constLength(Query::with) + constLength("SELECT ") + 1 + constLength(Query::from);
+    for (size_t i = 0; i < std::size(Query::columns); i++) {
+        const ColumnSpec& column = Query::columns[i];
+        length += (i ? 2 : 0) + constLength(column.name);
+        if (column.expr) {
+            length += constLength(column.expr) + constLength(" as ");
+        }
+    }
+    return length;
+}
+
+template<typename Query>
+constexpr FixedString<selectLength<Query>()> buildSelect() {
+    FixedString<selectLength<Query>()> sql;
+    size_t pos = constAppend(sql.data, 0, Query::with);
+    pos = constAppend(sql.data, pos, "SELECT ");
+    for (size_t i = 0; i < std::size(Query::columns); i++) {
+        const ColumnSpec& column = Query::columns[i];
+        if (i) {
+            pos = constAppend(sql.data, pos, ", ");
+        }
+        if (column.expr) {
+            pos = constAppend(sql.data, pos, column.expr);
+            pos = constAppend(sql.data, pos, " as ");
+        }
+        pos = constAppend(sql.data, pos, column.name);
+    }
+    pos = constAppend(sql.data, pos, " ");
+    constAppend(sql.data, pos, Query::from);
+    return sql;
+}
+
+template<typename Query>
+constexpr int tableWidth() {
+    int width = 0;
+    for (const ColumnSpec& column : Query::columns) {
+        width += column.width;
+    }
+    return width;
+}
+
+template<typename Query, size_t... I>
+std::tuple<typename ColumnTraits<Query::columns[I].type>::value_type...> columnTuple(std::index_sequence<I...>);
+
+// Все, что выводится из описания запроса: текст SQL, тип строки, декодер
+// и табличный вывод. Поиск колонки по имени (index) работает только на
+// этапе компиляции, опечатка в имени не соберется.
+template<typename Query>
+struct Table {
+    static constexpr size_t size = std::size(Query::columns);
+    using Row = decltype(columnTuple<Query>(std::make_index_sequence<size>()));
+    static constexpr auto sql = buildSelect<Query>();
+    static constexpr int width = tableWidth<Query>();
+    
+    static constexpr size_t index(const char* name) {
+        for (size_t i = 0; i < size; i++) {
+            if (constEqual(Query::columns[i].name, name)) {
+                return i;
+            }
+        }
+        throw std::logic_error("unknown column");
+    }
+    
+    static Row decode(const pqxx::row& row) {
+        return decodeRow(row, std::make_index_sequence<size>());
+    }
+    
+    template<size_t I>
+    static std::string text(const Row& row) {
+        return ColumnTraits<Query::columns[I].type>::format(std::get<I>(row));
+    }
+    
+    // Произвольный текст в ширину колонки I (итоговые строки отчетов)
+    template<size_t I>
+    static void pad(std::ostream& out, const std::string& text) {
+        out << std::left << std::setw(Query::columns[I].width) << text;
+    }
+    
+    // Память под декодированные строки: кортежи плюс текст строковых колонок
+    static size_t decodedBytes(const pqxx::result& result) {
+        size_t bytes = result.size() * sizeof(Row);
+        for (const auto& row : result) {
+            for (size_t i = 0; i < size; i++) {
+                if (Query::columns[i].type == ColumnType::Text) {
+                    bytes += row[static_cast<int>(i)].size();
+                }
+            }
+        }
+        return bytes;
+    }
+    
+    static void header(std::ostream& out) {
+        out << std::left;
+        for (const ColumnSpec& column : Query::columns) {
+            if (column.width > 0) {
+                out << std::setw(column.width) << column.header;
+            }
+        }
+        out << std::endl << std::string(width, '-') << std::endl;
+    }
+    
+    static void render(std::ostream& out, const Row& row) {
+        out << std::left;
+        renderRow(out, row, std::make_index_sequence<size>());
+        out << std::endl;
+    }
+    
+private:
+    template<size_t... I>
+    static Row decodeRow(const pqxx::row& row, std::index_sequence<I...>) {
+        return Row(ColumnTraits<Query::columns[I].type>::decode(row[static_cast<int>(I)])...);
+    }
+    
+    template<size_t I>
+    static void renderCell(std::ostream& out, const Row& row) {
+        if constexpr (Query::columns[I].width > 0) {
+            out << std::setw(Query::columns[I].width) << text<I>(row);
+        }
+    }
+    
+    template<size_t... I>
+    static void renderRow(std::ostream& out, const Row& row, std::index_sequence<I...>) {
+        (renderCell<I>(out, row), ...);
+    }
+};
+
+// Печать таблицы по порциям результата: заголовок перед первой строкой
+template<typename Query>
+class TablePrinter {
+private:
+    std::ostream& out;
+    size_t rows = 0;
+
+public:
+    explicit TablePrinter(std::ostream& stream) : out(stream) {}
+
+    void operator()(const pqxx::result& chunk) {
+        for (const auto& row : chunk) {
+            if (rows++ == 0) {
+                Table<Query>::header(out);
+            }
+            Table<Query>::render(out, Table<Query>::decode(row));
+        }
+    }
+
+    size_t rowCount() const { return rows; }
+};
+
+template<typename Query>
+constexpr StatementDef readStatement() {
+    return {Query::name, Table<Query>::sql.data, Query::sample_args, true,
+            Query::unbounded, &Table<Query>::decodedBytes};
+}
+
+struct TestDirectorsQuery : QuerySpec {
+    static constexpr const char* name = "test_directors";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"director_id", nullptr, "ID", ColumnType::Int, 5},
+        {"first_name", nullptr, "First Name", ColumnType::Text, 15},
+        {"last_name", nullptr, "Last Name", ColumnType::Text, 15},
+        {"nationality", nullptr, "Nationality", ColumnType::Text, 15},
+    };
+    static constexpr const char* from = "FROM directors ORDER BY director_id";
+};
+
+struct TestActorsQuery : QuerySpec {
+    static constexpr const char* name = "test_actors";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"actor_id", nullptr, "ID", ColumnType::Int, 5},
+        {"first_name", nullptr, "First Name", ColumnType::Text, 15},
+        {"last_name", nullptr, "Last Name", ColumnType::Text, 15},
+        {"nationality", nullptr, "Nationality", ColumnType::Text, 15},
+        {"is_oscar_winner", nullptr, "Oscar Winner", ColumnType::Flag, 12},
+    };
+    static constexpr const char* from = "FROM actors ORDER BY actor_id";
+};
+
+struct TestFilmsQuery : QuerySpec {
+    static constexpr const char* name = "test_films";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", "f.film_id", "ID", ColumnType::Int, 5},
+        {"title", "f.title", "Title", ColumnType::Text, 30},
+        {"release_year", "f.release_year", "Year", ColumnType::NullableInt, 8},
+        {"duration_minutes", "f.duration_minutes", "Duration", ColumnType::NullableMinutes, 12},
+        {"budget", "f.budget", "Budget", ColumnType::Money, 15},
+        {"box_office", "f.box_office", "Box Office", ColumnType::Money, 15},
+        {"director", "d.first_name || ' ' || d.last_name", "Director", ColumnType::Text, 20},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN directors d ON f.director_id = d.director_id "
+        "ORDER BY f.film_id";
+};
+
+struct TestGenresQuery : QuerySpec {
+    static constexpr const char* name = "test_genres";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"genre_id", nullptr, "ID", ColumnType::Int, 5},
+        {"name", nullptr, "Name", ColumnType::Text, 15},
+        {"description", nullptr, "Description", ColumnType::Text, 30},
+    };
+    static constexpr const char* from = "FROM genres ORDER BY genre_id";
+};
+
+struct TestRolesQuery : QuerySpec {
+    static constexpr const char* name = "test_roles";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", "Film", ColumnType::Text, 30},
+        {"actor", "a.first_name || ' ' || a.last_name", "Actor", ColumnType::Text, 25},
+        {"character_name", "fr.character_name", "Character", ColumnType::Text, 25},
+        {"is_main_role", "fr.is_main_role", "Main Role", ColumnType::Flag, 12},
+    };
+    static constexpr const char* from =
+        "FROM film_roles fr "
+        "JOIN films f ON fr.film_id = f.film_id "
+        "JOIN actors a ON fr.actor_id = a.actor_id "
+        "ORDER BY f.title, fr.is_main_role DESC";
+};
+
+struct TestReviewsQuery : QuerySpec {
+    static constexpr const char* name = "test_reviews";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", "Film", ColumnType::Text, 30},
+        {"reviewer_name", "r.reviewer_name", "Reviewer", ColumnType::Text, 15},
+        {"rating", "r.rating", "Rating", ColumnType::NullableDecimal, 10},
+        {"comment", "r.comment", "Comment", ColumnType::Text, 30},
+    };
+    static constexpr const char* from =
+        "FROM reviews r "
+        "JOIN films f ON r.film_id = f.film_id "
+        "ORDER BY f.title, r.rating DESC";
+};
+
+struct TestSummaryQuery : QuerySpec {
+    static constexpr const char* name = "test_summary";
+    static constexpr ColumnSpec columns[] = {
+        {"category", "'Directors'", "Category", ColumnType::Text, 15},
+        {"count", "COUNT(*)", "Count", ColumnType::Count, 10},
+    };
+    static constexpr const char* from =
+        "FROM directors "
+        "UNION ALL SELECT 'Actors', COUNT(*) FROM actors "
+        "UNION ALL SELECT 'Films', COUNT(*) FROM films "
+        "UNION ALL SELECT 'Genres', COUNT(*) FROM genres "
+        "UNION ALL SELECT 'Film Roles', COUNT(*) FROM film_roles "
+        "UNION ALL SELECT 'Reviews', COUNT(*) FROM reviews "
+        "UNION ALL SELECT 'Awards', COUNT(*) FROM awards "
+        "ORDER BY category";
+};
+
+struct FilmsByYearQuery : QuerySpec {
+    static constexpr const char* name = "films_by_year";
+    static constexpr bool unbounded = true;
+    static constexpr const char* sample_args = "2010";
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", "f.film_id", "ID", ColumnType::Int, 5},
+        {"title", "f.title", "Title", ColumnType::Text, 40},
+        {"duration_minutes", "f.duration_minutes", "Duration", ColumnType::NullableMinutes, 10},
+        {"director", "d.first_name || ' ' || d.last_name", "Director", ColumnType::Text, 25},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "LEFT JOIN directors d ON f.director_id = d.director_id "
+        "WHERE f.release_year = $1 "
+        "ORDER BY f.title";
+};
+
+struct DirectorStatsQuery : QuerySpec {
+    static constexpr const char* name = "director_stats";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"director_id", "d.director_id", nullptr, ColumnType::Int, 0},
+        {"director_name", "d.first_name || ' ' || d.last_name", "Director", ColumnType::Text, 25},
+        {"film_count", "COUNT(f.film_id)", "Films", ColumnType::Count, 10},
+        {"total_box_office", "SUM(f.box_office)", "Total Box Office", ColumnType::Money, 18},
+        {"avg_box_office", "AVG(f.box_office)", "Average", ColumnType::Money, 15},
+    };
+    static constexpr const char* from =
+        "FROM directors d "
+        "LEFT JOIN films f ON d.director_id = f.director_id "
+        "GROUP BY d.director_id, director_name "
+        "HAVING COUNT(f.film_id) > 0 "
+        "ORDER BY total_box_office DESC NULLS LAST";
+};
+
+struct ActorsByFilmQuery : QuerySpec {
+    static constexpr const char* name = "actors_by_film";
+    static constexpr bool unbounded = true;
+    static constexpr const char* sample_args = "'a'";
+    static constexpr ColumnSpec columns[] = {
+        {"actor_id", "a.actor_id", nullptr, ColumnType::Int, 0},
+        {"actor_name", "a.first_name || ' ' || a.last_name", "Actor", ColumnType::Text, 25},
+        {"character_name", "fr.character_name", "Character", ColumnType::Text, 25},
+        {"is_main_role", "fr.is_main_role", "Main Role", ColumnType::Flag, 10},
+    };
+    static constexpr const char* from =
+        "FROM film_roles fr "
+        "JOIN actors a ON fr.actor_id = a.actor_id "
+        "JOIN films f ON fr.film_id = f.film_id "
+        "WHERE LOWER(f.title) LIKE LOWER('%' || $1 || '%') "
+        "ORDER BY fr.is_main_role DESC, a.last_name";
+};
+
+struct TopGrossingQuery : QuerySpec {
+    static constexpr const char* name = "top_grossing";
+    static constexpr bool unbounded = true;
+    static constexpr const char* sample_args = "10";
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", "Title", ColumnType::Text, 35},
+        {"release_year", "f.release_year", "Year", ColumnType::NullableInt, 8},
+        {"box_office", "f.box_office", "Box Office", ColumnType::Money, 15},
+        {"director", "d.first_name || ' ' || d.last_name", "Director", ColumnType::Text, 20},
+        {"roi", "ROUND((f.box_office - f.budget) / f.budget * 100, 2)", "ROI %", ColumnType::Decimal, 10},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN directors d ON f.director_id = d.director_id "
+        "WHERE f.box_office > 0 AND f.budget > 0 "
+        "ORDER BY f.box_office DESC "
+        "LIMIT $1";
+};
+
+struct LeaderboardSeedQuery : QuerySpec {
+    static constexpr const char* name = "leaderboard_seed";
+    static constexpr const char* sample_args = "200";
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", "f.film_id", nullptr, ColumnType::Int, 0},
+        {"title", "f.title", nullptr, ColumnType::Text, 0},
+        {"release_year", "f.release_year", nullptr, ColumnType::Int, 0},
+        {"box_office", "f.box_office", nullptr, ColumnType::Decimal, 0},
+        {"budget", "f.budget", nullptr, ColumnType::Decimal, 0},
+        {"director", "d.first_name || ' ' || d.last_name", nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN directors d ON f.director_id = d.director_id "
+        "WHERE f.box_office > 0 AND f.budget > 0 "
+        "ORDER BY f.box_office DESC, f.film_id DESC "
+        "LIMIT $1";
+};
+
+// Те же колонки, что и у leaderboard_seed, но по списку фильмов
+struct LeaderboardFilmsQuery : LeaderboardSeedQuery {
+    static constexpr const char* name = "leaderboard_films";
+    static constexpr const char* sample_args = "'{1}'";
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN directors d ON f.director_id = d.director_id "
+        "WHERE f.film_id = ANY($1::int[])";
+};
+
+struct FilmsByGenreQuery : QuerySpec {
+    static constexpr const char* name = "films_by_genre";
+    static constexpr bool unbounded = true;
+    static constexpr const char* sample_args = "'drama'";
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", "Title", ColumnType::Text, 35},
+        {"release_year", "f.release_year", "Year", ColumnType::NullableInt, 8},
+        {"duration_minutes", "f.duration_minutes", "Duration", ColumnType::NullableMinutes, 10},
+        {"genres", "STRING_AGG(g.name, ', ')", "Genres", ColumnType::Text, 25},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN film_genres fg ON f.film_id = fg.film_id "
+        "JOIN genres g ON fg.genre_id = g.genre_id "
+        "WHERE LOWER(g.name) LIKE LOWER('%' || $1 || '%') "
+        "GROUP BY f.film_id, f.title, f.release_year, f.duration_minutes "
+        "ORDER BY f.release_year DESC";
+};
+
+struct AvgRatingsQuery : QuerySpec {
+    static constexpr const char* name = "avg_ratings";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", "Title", ColumnType::Text, 35},
+        {"avg_rating", "ROUND(AVG(r.rating), 2)", "Avg Rating", ColumnType::Decimal, 12},
+        {"review_count", "COUNT(r.review_id)", "Reviews", ColumnType::Count, 12},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "LEFT JOIN reviews r ON f.film_id = r.film_id "
+        "GROUP BY f.film_id, f.title "
+        "HAVING COUNT(r.review_id) >= 1 "
+        "ORDER BY avg_rating DESC";
+};
+
+struct RatingAggregatesQuery : QuerySpec {
+    static constexpr const char* name = "rating_aggregates";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", "f.film_id", nullptr, ColumnType::Int, 0},
+        {"title", "f.title", nullptr, ColumnType::Text, 0},
+        {"review_count", "COUNT(r.review_id)", nullptr, ColumnType::Count, 0},
+        {"rating_sum", "SUM(r.rating)", nullptr, ColumnType::Decimal, 0},
+        {"min_rating", "MIN(r.rating)", nullptr, ColumnType::Decimal, 0},
+        {"max_rating", "MAX(r.rating)", nullptr, ColumnType::Decimal, 0},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN reviews r ON f.film_id = r.film_id "
+        "GROUP BY f.film_id, f.title";
+};
+
+// Те же колонки, что и у rating_aggregates, но по списку фильмов
+struct FilmRatingAggregatesQuery : RatingAggregatesQuery {
+    static constexpr const char* name = "film_rating_aggregates";
+    static constexpr bool unbounded = false;
+    static constexpr const char* sample_args = "'{1}'";
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN reviews r ON f.film_id = r.film_id "
+        "WHERE f.film_id = ANY($1::int[]) "
+        "GROUP BY f.film_id, f.title";
+};
+
+struct FilmTitlesQuery : QuerySpec {
+    static constexpr const char* name = "film_titles";
+    static constexpr const char* sample_args = "'{1}'";
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", nullptr, nullptr, ColumnType::Int, 0},
+        {"title", nullptr, nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from = "FROM films WHERE film_id = ANY($1::int[])";
+};
+
+// Любой INSERT или UPDATE дает строке xmin новой транзакции, поэтому
+// MAX(xmin) меняется и при правках, которые не видны в суммах (переименование
+// фильма или режиссера); удаления видны по COUNT
+struct CatalogFingerprintQuery : QuerySpec {
+    static constexpr const char* name = "catalog_fingerprint";
+    static constexpr ColumnSpec columns[] = {
+        {"fingerprint",
+            "(SELECT COUNT(*) || ':' || COALESCE(MAX(film_id), 0) || ':' || "
+            "        COALESCE(MAX(xmin::text::bigint), 0) FROM films) || ':' || "
+            "(SELECT COUNT(*) || ':' || COALESCE(MAX(director_id), 0) || ':' || "
+            "        COALESCE(MAX(xmin::text::bigint), 0) FROM directors) || ':' || "
+            "(SELECT COUNT(*) || ':' || COALESCE(MAX(review_id), 0) || ':' || "
+            "        COALESCE(MAX(xmin::text::bigint), 0) FROM reviews)",
+            nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from = "";
+};
+
+// Поиск с постраничной выдачей по ключу (rank, id): $2/$3 - ранг и id
+// последней строки предыдущей страницы, для первой 'Infinity' и максимум.
+// Ранжируются все совпадения, ts_rank считается один раз на строку.
+// $5 - явное ограничение: при $5 > 0 ранжируются только $5 самых новых
+// совпадений, а колонка capped сообщает, что совпадений было больше.
+// Ветви candidates отсекаются по $5 еще до чтения таблицы (One-Time
+// Filter), так что без ограничения совпадения не сортируются по id.
+// ts_headline дорогой, поэтому считается только для строк страницы.
+// Ранг читается текстом, чтобы без потерь вернуться в следующий запрос.
+struct SearchReviewsQuery : QuerySpec {
+    static constexpr const char* name = "search_reviews";
+    static constexpr const char* sample_args = "'great film', 'Infinity', 2147483647, 10, 0";
+    static constexpr const char* with =
+        "WITH candidates AS ("
+        "  SELECT r.review_id, r.film_id, r.reviewer_name, r.rating, r.comment, r.search_vector "
+        "  FROM reviews r "
+        "  WHERE $5::int = 0 AND r.search_vector @@ websearch_to_tsquery('english', $1) "
+        "  UNION ALL "
+        "  (SELECT r.review_id, r.film_id, r.reviewer_name, r.rating, r.comment, r.search_vector "
+        "   FROM reviews r "
+        "   WHERE $5::int > 0 AND r.search_vector @@ websearch_to_tsquery('english', $1) "
+        "   ORDER BY r.review_id DESC "
+        "   LIMIT $5::int)"
+        "), ranked AS ("
+        "  SELECT c.review_id, c.film_id, c.reviewer_name, c.rating, c.comment, "
+        "    ts_rank(c.search_vector, websearch_to_tsquery('english', $1)) as rank "
+        "  FROM candidates c"
+        "), hits AS ("
+        "  SELECT * FROM ranked "
+        "  WHERE (rank, review_id) < ($2::real, $3::int) "
+        "  ORDER BY rank DESC, review_id DESC "
+        "  LIMIT $4"
+        ") ";
+    static constexpr ColumnSpec columns[] = {
+        {"review_id", "h.review_id", nullptr, ColumnType::Int, 0},
+        {"title", "f.title", "Film", ColumnType::Text, 30},
+        {"reviewer_name", "h.reviewer_name", "Reviewer", ColumnType::Text, 15},
+        {"rating", "h.rating", "Rating", ColumnType::NullableDecimal, 8},
+        {"rank", "h.rank", "Rank", ColumnType::Text, 10},
+        {"snippet",
+            "ts_headline('english', h.comment, websearch_to_tsquery('english', $1), "
+            "  'StartSel=[, StopSel=], MaxFragments=2, MaxWords=15, MinWords=5')",
+            "Snippet", ColumnType::Text, 37},
+        {"capped",
+            "CASE WHEN $5::int > 0 THEN (SELECT COUNT(*) > $5::int FROM (SELECT 1 FROM reviews m "
+            "  WHERE m.search_vector @@ websearch_to_tsquery('english', $1) LIMIT $5::int + 1) matches) "
+            "ELSE false END",
+            nullptr, ColumnType::Flag, 0},
+    };
+    static constexpr const char* from =
+        "FROM hits h "
+        "JOIN films f ON h.film_id = f.film_id "
+        "ORDER BY h.rank DESC, h.review_id DESC";
+};
+
+struct SearchFilmsQuery : QuerySpec {
+    static constexpr const char* name = "search_films";
+    static constexpr const char* sample_args = "'dark knight', 'Infinity', 2147483647, 10, 0";
+    static constexpr const char* with =
+        "WITH candidates AS ("
+        "  SELECT f.film_id, f.title, f.release_year, f.search_vector "
+        "  FROM films f "
+        "  WHERE $5::int = 0 AND f.search_vector @@ websearch_to_tsquery('english', $1) "
+        "  UNION ALL "
+        "  (SELECT f.film_id, f.title, f.release_year, f.search_vector "
+        "   FROM films f "
+        "   WHERE $5::int > 0 AND f.search_vector @@ websearch_to_tsquery('english', $1) "
+        "   ORDER BY f.film_id DESC "
+        "   LIMIT $5::int)"
+        "), ranked AS ("
+        "  SELECT c.film_id, c.title, c.release_year, "
+        "    ts_rank(c.search_vector, websearch_to_tsquery('english', $1)) as rank "
+        "  FROM candidates c"
+        "), hits AS ("
+        "  SELECT * FROM ranked "
+        "  WHERE (rank, film_id) < ($2::real, $3::int) "
+        "  ORDER BY rank DESC, film_id DESC "
+        "  LIMIT $4"
+        ") ";
+    static constexpr ColumnSpec columns[] = {
+        {"film_id", "h.film_id", "ID", ColumnType::Int, 5},
+        {"title",
+            "ts_headline('english', h.title, websearch_to_tsquery('english', $1), "
+            "  'StartSel=[, StopSel=], HighlightAll=true')",
+            "Title", ColumnType::Text, 45},
+        {"release_year", "h.release_year", "Year", ColumnType::NullableInt, 8},
+        {"rank", "h.rank", "Rank", ColumnType::Text, 10},
+        {"capped",
+            "CASE WHEN $5::int > 0 THEN (SELECT COUNT(*) > $5::int FROM (SELECT 1 FROM films m "
+            "  WHERE m.search_vector @@ websearch_to_tsquery('english', $1) LIMIT $5::int + 1) matches) "
+            "ELSE false END",
+            nullptr, ColumnType::Flag, 0},
+    };
+    static constexpr const char* from =
+        "FROM hits h "
+        "ORDER BY h.rank DESC, h.film_id DESC";
+};
+
+struct DemoNolanFilmsQuery : QuerySpec {
+    static constexpr const char* name = "demo_nolan_films";
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", nullptr, ColumnType::Text, 0},
+        {"release_year", "f.release_year", nullptr, ColumnType::NullableInt, 0},
+        {"budget", "f.budget", nullptr, ColumnType::Money, 0},
+        {"box_office", "f.box_office", nullptr, ColumnType::Money, 0},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN directors d ON f.director_id = d.director_id "
+        "WHERE d.first_name = 'Christopher' AND d.last_name = 'Nolan'";
+};
+
+struct DemoAvgBudgetQuery : QuerySpec {
+    static constexpr const char* name = "demo_avg_budget";
+    static constexpr ColumnSpec columns[] = {
+        {"release_year", nullptr, nullptr, ColumnType::NullableInt, 0},
+        {"avg_budget", "AVG(budget)", nullptr, ColumnType::Money, 0},
+        {"film_count", "COUNT(*)", nullptr, ColumnType::Count, 0},
+    };
+    static constexpr const char* from =
+        "FROM films "
+        "GROUP BY release_year "
+        "HAVING COUNT(*) > 0 "
+        "ORDER BY release_year DESC";
+};
+
+struct DemoAboveAvgQuery : QuerySpec {
+    static constexpr const char* name = "demo_above_avg";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", nullptr, nullptr, ColumnType::Text, 0},
+        {"box_office", nullptr, nullptr, ColumnType::Money, 0},
+    };
+    static constexpr const char* from =
+        "FROM films "
+        "WHERE box_office > (SELECT AVG(box_office) FROM films) "
+        "ORDER BY box_office DESC";
+};
+
+struct DemoDirectorCountsQuery : QuerySpec {
+    static constexpr const char* name = "demo_director_counts";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"director", "d.first_name || ' ' || d.last_name", nullptr, ColumnType::Text, 0},
+        {"film_count", "COUNT(f.film_id)", nullptr, ColumnType::Count, 0},
+    };
+    static constexpr const char* from =
+        "FROM directors d "
+        "LEFT JOIN films f ON d.director_id = f.director_id "
+        "GROUP BY d.director_id "
+        "ORDER BY film_count DESC";
+};
+
+struct DemoFilmGenresQuery : QuerySpec {
+    static constexpr const char* name = "demo_film_genres";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", "f.title", nullptr, ColumnType::Text, 0},
+        {"genres", "STRING_AGG(g.name, ', ')", nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM films f "
+        "JOIN film_genres fg ON f.film_id = fg.film_id "
+        "JOIN genres g ON fg.genre_id = g.genre_id "
+        "GROUP BY f.film_id, f.title "
+        "ORDER BY f.title";
+};
+
+struct DemoTop3Query : QuerySpec {
+    static constexpr const char* name = "demo_top3";
+    static constexpr ColumnSpec columns[] = {
+        {"title", nullptr, nullptr, ColumnType::Text, 0},
+        {"box_office", nullptr, nullptr, ColumnType::Money, 0},
+    };
+    static constexpr const char* from =
+        "FROM films "
+        "ORDER BY box_office DESC "
+        "LIMIT 3";
+};
+
+struct DemoProfitabilityQuery : QuerySpec {
+    static constexpr const char* name = "demo_profitability";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", nullptr, nullptr, ColumnType::Text, 0},
+        {"budget", nullptr, nullptr, ColumnType::Money, 0},
+        {"box_office", nullptr, nullptr, ColumnType::Money, 0},
+        {"profitability",
+            "CASE "
+            "  WHEN box_office > budget * 5 THEN 'Blockbuster' "
+            "  WHEN box_office > budget * 2 THEN 'Successful' "
+            "  WHEN box_office > budget THEN 'Profitable' "
+            "  ELSE 'Unprofitable' "
+            "END",
+            nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM films "
+        "ORDER BY box_office DESC";
+};
+
+struct DemoYearlyRankQuery : QuerySpec {
+    static constexpr const char* name = "demo_yearly_rank";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"title", nullptr, nullptr, ColumnType::Text, 0},
+        {"release_year", nullptr, nullptr, ColumnType::NullableInt, 0},
+        {"box_office", nullptr, nullptr, ColumnType::Money, 0},
+        {"yearly_rank", "RANK() OVER (PARTITION BY release_year ORDER BY box_office DESC)",
+            nullptr, ColumnType::Count, 0},
+    };
+    static constexpr const char* from =
+        "FROM films "
+        "ORDER BY release_year, yearly_rank";
+};
+
+struct DemoPeopleQuery : QuerySpec {
+    static constexpr const char* name = "demo_people";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"name", "first_name || ' ' || last_name", nullptr, ColumnType::Text, 0},
+        {"role", "'Director'", nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM directors "
+        "UNION "
+        "SELECT first_name || ' ' || last_name as name, 'Actor' as role "
+        "FROM actors "
+        "ORDER BY name "
+        "LIMIT 5";
+};
+
+struct DemoAwardDirectorsQuery : QuerySpec {
+    static constexpr const char* name = "demo_award_directors";
+    static constexpr bool unbounded = true;
+    static constexpr ColumnSpec columns[] = {
+        {"director", "d.first_name || ' ' || d.last_name", nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM directors d "
+        "WHERE EXISTS ("
+        "  SELECT 1 FROM films f "
+        "  JOIN film_awards fa ON f.film_id = fa.film_id "
+        "  WHERE f.director_id = d.director_id"
+        ")";
+};
+
+struct DurationStatsQuery : QuerySpec {
+    static constexpr const char* name = "duration_stats";
+    static constexpr const char* with =
+        "WITH duration_categories AS ("
+        "  SELECT "
+        "    f.film_id, "
+        "    f.title, "
+        "    f.duration_minutes, "
+        "    r.rating, "
+        "    CASE "
+        "      WHEN f.duration_minutes < 100 THEN 'Short (< 100 min)' "
+        "      WHEN f.duration_minutes >= 100 AND f.duration_minutes < 200 THEN 'Medium (100-200 min)' "
+        "      WHEN f.duration_minutes >= 200 THEN 'Long (≥ 200 min)' "
+        "      ELSE 'Unknown' "
+        "    END as duration_category "
+        "  FROM films f "
+        "  LEFT JOIN reviews r ON f.film_id = r.film_id "
+        ") ";
+    static constexpr ColumnSpec columns[] = {
+        {"duration_category", nullptr, "Duration Category", ColumnType::Text, 25},
+        {"film_count", "COUNT(DISTINCT film_id)", "Films", ColumnType::Count, 12},
+        {"avg_duration", "ROUND(AVG(duration_minutes)::numeric, 1)", "Avg Duration", ColumnType::AvgMinutes, 15},
+        {"avg_rating", "ROUND(AVG(rating)::numeric, 2)", "Avg Rating", ColumnType::Decimal, 12},
+        {"min_rating", "MIN(rating)", "Min Rating", ColumnType::Decimal, 12},
+        {"max_rating", "MAX(rating)", "Max Rating", ColumnType::Decimal, 12},
+        {"films", "STRING_AGG(DISTINCT title, ', ' ORDER BY title)", nullptr, ColumnType::Text, 0},
+    };
+    static constexpr const char* from =
+        "FROM duration_categories "
+        "GROUP BY duration_category "
+        "HAVING COUNT(DISTINCT film_id) > 0 "
+        "ORDER BY "
+        "  CASE duration_category "
+        "    WHEN 'Short (< 100 min)' THEN 1 "
+        "    WHEN 'Medium (100-200 min)' THEN 2 "
+        "    WHEN 'Long (≥ 200 min)' THEN 3 "
+        "    ELSE 4 "
+        "  END";
+};
+
+static const StatementDef STATEMENTS[] = {
+    readStatement<TestDirectorsQuery>(),
+    readStatement<TestActorsQuery>(),
+    readStatement<TestFilmsQuery>(),
+    readStatement<TestGenresQuery>(),
+    readStatement<TestRolesQuery>(),
+    readStatement<TestReviewsQuery>(),
+    readStatement<TestSummaryQuery>(),
+    readStatement<FilmsByYearQuery>(),
+    readStatement<DirectorStatsQuery>(),
+    readStatement<ActorsByFilmQuery>(),
+    readStatement<TopGrossingQuery>(),
+    readStatement<LeaderboardSeedQuery>(),
+    readStatement<LeaderboardFilmsQuery>(),
+    {"add_actor",
+        "INSERT INTO actors (first_name, last_name, birth_date, nationality, is_oscar_winner) "
+        "VALUES ($1, $2, $3, $4, $5) RETURNING actor_id",
+        "'Test', 'Actor', '1980-01-01', 'Test', false", false},
+    readStatement<FilmsByGenreQuery>(),
+    readStatement<AvgRatingsQuery>(),
+    readStatement<RatingAggregatesQuery>(),
+    readStatement<FilmRatingAggregatesQuery>(),
+    readStatement<FilmTitlesQuery>(),
+    readStatement<CatalogFingerprintQuery>(),
+    readStatement<SearchReviewsQuery>(),
+    readStatement<SearchFilmsQuery>(),
+    {"add_review",
+        "INSERT INTO reviews (film_id, reviewer_name, rating, comment) "
+        "VALUES ($1, $2, $3, $4)",
+        "1, 'Test', 8.5, 'Test'", false},
+    {"add_film",
+        "INSERT INTO films (title, release_year, duration_minutes, budget, box_office, director_id) "
+        "VALUES ($1, $2, $3, $4, $5, $6) RETURNING film_id",
+        "'Test', 2020, 120, 1000000, 2000000, 1", false},
+    {"update_box_office",
+        "UPDATE films SET box_office = $1 WHERE film_id = $2",
+        "1000000, 1", false},
+    readStatement<DemoNolanFilmsQuery>(),
+    readStatement<DemoAvgBudgetQuery>(),
+    readStatement<DemoAboveAvgQuery>(),
+    readStatement<DemoDirectorCountsQuery>(),
+    readStatement<DemoFilmGenresQuery>(),
+    readStatement<DemoTop3Query>(),
+    readStatement<DemoProfitabilityQuery>(),
+    readStatement<DemoYearlyRankQuery>(),
+    readStatement<DemoPeopleQuery>(),
+    readStatement<DemoAwardDirectorsQuery>(),
+    readStatement<DurationStatsQuery>(),
+};
+
+// Неограниченный запрос приложение читает курсором, объявленным по тексту
+// запроса: DECLARE не может сослаться на подготовленный запрос. Курсор
+// всегда дочитывается до конца, поэтому план строится под все строки, а не
+// под первые 10% (cursor_tuple_fraction). Проверка планов объясняет такие
+// запросы в этой же форме.
+static const char* const CURSOR_SETTINGS = "SET LOCAL cursor_tuple_fraction = 1.0";
+
+static std::string declareCursor(const std::string& cursor, const std::string& sql) {
+    return "DECLARE " + cursor + " NO SCROLL CURSOR FOR " + sql;
+}
+
+// Версионированные миграции схемы. Каждая применяется один раз и
+// записывается в schema_migrations; сами DDL тоже идемпотентны, чтобы
+// миграция спокойно проходила на базе, созданной раньше вручную.
+struct Migration {
+    int version;
+    const char* name;
+    const char* sql;
+};
+
+static const Migration MIGRATIONS[] = {
+    {1, "initial_schema",
+        "CREATE TABLE IF NOT EXISTS directors ("
+        "  director_id SERIAL PRIMARY KEY, "
+        "  first_name VARCHAR(50) NOT NULL, "
+        "  last_name VARCHAR(50) NOT NULL, "
+        "  birth_date DATE, "
+        "  nationality VARCHAR(50)"
+        "); "
+        "CREATE TABLE IF NOT EXISTS actors ("
+        "  actor_id SERIAL PRIMARY KEY, "
+        "  first_name VARCHAR(50) NOT NULL, "
+        "  last_name VARCHAR(50) NOT NULL, "
+        "  birth_date DATE, "
+        "  nationality VARCHAR(50), "
+        "  is_oscar_winner BOOLEAN NOT NULL DEFAULT FALSE"
+        "); "
+        "CREATE TABLE IF NOT EXISTS films ("
+        "  film_id SERIAL PRIMARY KEY, "
+        "  title VARCHAR(200) NOT NULL, "
+        "  release_year INTEGER, "
+        "  duration_minutes INTEGER, "
+        "  budget NUMERIC(15, 2), "
+        "  box_office NUMERIC(15, 2), "
+        "  director_id INTEGER REFERENCES directors(director_id)"
+        "); "
+        "CREATE TABLE IF NOT EXISTS genres ("
+        "  genre_id SERIAL PRIMARY KEY, "
+        "  name VARCHAR(50) NOT NULL UNIQUE, "
+        "  description TEXT"
+        "); "
+        "CREATE TABLE IF NOT EXISTS film_genres ("
+        "  film_id INTEGER REFERENCES films(film_id) ON DELETE CASCADE, "
+        "  genre_id INTEGER REFERENCES genres(genre_id) ON DELETE CASCADE, "
+        "  PRIMARY KEY (film_id, genre_id)"
+        "); "
+        "CREATE TABLE IF NOT EXISTS film_roles ("
+        "  role_id SERIAL PRIMARY KEY, "
+        "  film_id INTEGER REFERENCES films(film_id) ON DELETE CASCADE, "
+        "  actor_id INTEGER REFERENCES actors(actor_id) ON DELETE CASCADE, "
+        "  character_name VARCHAR(100), "
+        "  is_main_role BOOLEAN NOT NULL DEFAULT FALSE"
+        "); "
+        "CREATE TABLE IF NOT EXISTS reviews ("
+        "  review_id SERIAL PRIMARY KEY, "
+        "  film_id INTEGER REFERENCES films(film_id) ON DELETE CASCADE, "
+        "  reviewer_name VARCHAR(100), "
+        "  rating NUMERIC(3, 1) CHECK (rating BETWEEN 0 AND 10), "
+        "  comment TEXT"
+        "); "
+        "CREATE TABLE IF NOT EXISTS awards ("
+        "  award_id SERIAL PRIMARY KEY, "
+        "  name VARCHAR(100) NOT NULL, "
+        "  category VARCHAR(100)"
+        "); "
+        "CREATE TABLE IF NOT EXISTS film_awards ("
+        "  film_id INTEGER REFERENCES films(film_id) ON DELETE CASCADE, "
+        "  award_id INTEGER REFERENCES awards(award_id) ON DELETE CASCADE, "
+        "  award_year INTEGER, "
+        "  PRIMARY KEY (film_id, award_id)"
+        ")"},
+    // Индексы под JOIN и сортировки запросов из STATEMENTS
+    {2, "performance_indexes",
+        "CREATE INDEX IF NOT EXISTS idx_films_director_id ON films (director_id); "
+        "CREATE INDEX IF NOT EXISTS idx_films_release_year ON films (release_year) "
+        "  INCLUDE (title, duration_minutes, director_id); "
+        // Покрывающий индекс для getTopGrossingFilms и топ-3 из демонстрации
+        "CREATE INDEX IF NOT EXISTS idx_films_box_office ON films (box_office DESC) "
+        "  INCLUDE (title, release_year, budget, director_id); "
+        "CREATE INDEX IF NOT EXISTS idx_film_roles_film_id ON film_roles (film_id) "
+        "  INCLUDE (actor_id, character_name, is_main_role); "
+        "CREATE INDEX IF NOT EXISTS idx_film_roles_actor_id ON film_roles (actor_id); "
+        "CREATE INDEX IF NOT EXISTS idx_film_genres_genre_id ON film_genres (genre_id); "
+        // Покрывающий индекс для средних рейтингов: достаточно index-only scan
+        "CREATE INDEX IF NOT EXISTS idx_reviews_film_id ON reviews (film_id) "
+        "  INCLUDE (rating); "
+        "CREATE INDEX IF NOT EXISTS idx_directors_name ON directors (last_name, first_name); "
+        "CREATE INDEX IF NOT EXISTS idx_film_awards_award_id ON film_awards (award_id); "
+        // Триграммные индексы для поиска подстроки LIKE '%...%' в actors_by_film
+        // и films_by_genre: B-tree такой шаблон не использует
+        "CREATE EXTENSION IF NOT EXISTS pg_trgm; "
+        "CREATE INDEX IF NOT EXISTS idx_films_title_trgm ON films "
+        "  USING GIN (LOWER(title) gin_trgm_ops); "
+        "CREATE INDEX IF NOT EXISTS idx_genres_name_trgm ON genres "
+        "  USING GIN (LOWER(name) gin_trgm_ops)"},
+    // Уведомления об изменениях фильмов для топа по сборам в памяти
+    {3, "films_change_notifications",
+        "CREATE OR REPLACE FUNCTION notify_films_changed() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  IF TG_OP = 'DELETE' THEN "
+        "    PERFORM pg_notify('films_changed', OLD.film_id::text); "
+        "  ELSE "
+        "    PERFORM pg_notify('films_changed', NEW.film_id::text); "
+        "  END IF; "
+        "  RETURN NULL; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS films_changed ON films; "
+        // Только колонки, которые видит топ: обновление search_vector не уведомляет
+        "CREATE TRIGGER films_changed "
+        "  AFTER INSERT OR DELETE OR UPDATE OF box_office, budget, title, release_year, director_id ON films "
+        "  FOR EACH ROW EXECUTE PROCEDURE notify_films_changed()"},
+    // Полнотекстовый поиск: tsvector-колонки, которые ведут триггеры.
+    // Колонка без DEFAULT добавляется без перезаписи таблицы; старые строки
+    // заполняет и GIN-индексы строит SearchIndexBuilder в фоне.
+    // В вектор фильма кроме названия входят имя режиссера и жанры.
+    {4, "full_text_search",
+        "ALTER TABLE films ADD COLUMN IF NOT EXISTS search_vector tsvector; "
+        "ALTER TABLE reviews ADD COLUMN IF NOT EXISTS search_vector tsvector; "
+        "CREATE OR REPLACE FUNCTION film_search_vector(p_film_id INTEGER, p_title TEXT, "
+        "                                              p_director_id INTEGER) RETURNS tsvector AS $$ "
+        "  SELECT setweight(to_tsvector('english', coalesce(p_title, '')), 'A') || "
+        "         setweight(to_tsvector('english', coalesce((SELECT first_name || ' ' || last_name "
+        "             FROM directors WHERE director_id = p_director_id), '')), 'B') || "
+        "         setweight(to_tsvector('english', coalesce((SELECT string_agg(g.name, ' ') "
+        "             FROM film_genres fg JOIN genres g ON g.genre_id = fg.genre_id "
+        "             WHERE fg.film_id = p_film_id), '')), 'C') "
+        "$$ LANGUAGE sql STABLE; "
+        "CREATE OR REPLACE FUNCTION films_search_vector_update() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  NEW.search_vector := film_search_vector(NEW.film_id, NEW.title, NEW.director_id); "
+        "  RETURN NEW; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS films_search_vector ON films; "
+        "CREATE TRIGGER films_search_vector BEFORE INSERT OR UPDATE OF title, director_id ON films "
+        "  FOR EACH ROW EXECUTE PROCEDURE films_search_vector_update(); "
+        "CREATE OR REPLACE FUNCTION reviews_search_vector_update() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  NEW.search_vector := to_tsvector('english', coalesce(NEW.comment, '')); "
+        "  RETURN NEW; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS reviews_search_vector ON reviews; "
+        "CREATE TRIGGER reviews_search_vector BEFORE INSERT OR UPDATE OF comment ON reviews "
+        "  FOR EACH ROW EXECUTE PROCEDURE reviews_search_vector_update(); "
+        // Смена жанров фильма или имени режиссера/жанра пересчитывает векторы фильмов
+        "CREATE OR REPLACE FUNCTION film_genres_search_vector_update() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  UPDATE films SET search_vector = film_search_vector(film_id, title, director_id) "
+        "  WHERE film_id = CASE WHEN TG_OP = 'DELETE' THEN OLD.film_id ELSE NEW.film_id END; "
+        "  RETURN NULL; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS film_genres_search_vector ON film_genres; "
+        "CREATE TRIGGER film_genres_search_vector AFTER INSERT OR DELETE ON film_genres "
+        "  FOR EACH ROW EXECUTE PROCEDURE film_genres_search_vector_update(); "
+        "CREATE OR REPLACE FUNCTION directors_search_vector_update() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  UPDATE films SET search_vector = film_search_vector(film_id, title, director_id) "
+        "  WHERE director_id = NEW.director_id; "
+        "  RETURN NULL; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS directors_search_vector ON directors; "
+        "CREATE TRIGGER directors_search_vector AFTER UPDATE OF first_name, last_name ON directors "
+        "  FOR EACH ROW EXECUTE PROCEDURE directors_search_vector_update(); "
+        "CREATE OR REPLACE FUNCTION genres_search_vector_update() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  UPDATE films SET search_vector = film_search_vector(film_id, title, director_id) "
+        "  WHERE film_id IN (SELECT film_id FROM film_genres WHERE genre_id = NEW.genre_id); "
+        "  RETURN NULL; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS genres_search_vector ON genres; "
+        "CREATE TRIGGER genres_search_vector AFTER UPDATE OF name ON genres "
+        "  FOR EACH ROW EXECUTE PROCEDURE genres_search_vector_update()"},
+    // Уведомления об изменениях отзывов для агрегатов рейтингов в памяти;
+    // срабатывает и на каскадное удаление отзывов вместе с фильмом
+    {5, "reviews_change_notifications",
+        "CREATE OR REPLACE FUNCTION notify_reviews_changed() RETURNS trigger AS $$ "
+        "BEGIN "
+        "  IF TG_OP IN ('UPDATE', 'DELETE') THEN "
+        "    PERFORM pg_notify('reviews_changed', OLD.film_id::text); "
+        "  END IF; "
+        "  IF TG_OP IN ('INSERT', 'UPDATE') THEN "
+        "    PERFORM pg_notify('reviews_changed', NEW.film_id::text); "
+        "  END IF; "
+        "  RETURN NULL; "
+        "END; "
+        "$$ LANGUAGE plpgsql; "
+        "DROP TRIGGER IF EXISTS reviews_changed ON reviews; "
+        // Только колонки агрегатов рейтингов, без comment и search_vector
+        "CREATE TRIGGER reviews_changed "
+        "  AFTER INSERT OR DELETE OR UPDATE OF film_id, rating ON reviews "
+        "  FOR EACH ROW EXECUTE PROCEDURE notify_reviews_changed()"},
+};
+
+// Применяет недостающие миграции при старте приложения
+class SchemaMigrator {
+private:
+    pqxx::connection& conn;
+
+public:
+    explicit SchemaMigrator(pqxx::connection& connection) : conn(connection) {}
+
+    // Блокировка не дает двум экземплярам приложения менять схему одновременно
+    static void lockMigrations(pqxx::work& txn) {
+        txn.exec("SELECT pg_advisory_xact_lock(hashtext('cinema_db.schema_migrations'))");
+    }
+
+    // Возвращает количество примененных миграций
+    int migrate() {
+        {
+            // IF NOT EXISTS не защищает от гонки двух CREATE TABLE (конфликт в pg_type)
+            pqxx::work txn(conn);
+            lockMigrations(txn);
+            txn.exec("CREATE TABLE IF NOT EXISTS schema_migrations ("
+                     "  version INTEGER PRIMARY KEY, "
+                     "  name VARCHAR(100) NOT NULL, "
+                     "  applied_at TIMESTAMP NOT NULL DEFAULT now()"
+                     ")");
+            txn.commit();
+        }
+
+        int applied = 0;
+        for (const auto& migration : MIGRATIONS) {
+            pqxx::work txn(conn);
+            lockMigrations(txn);
+            pqxx::result done = txn.exec_params(
+                "SELECT 1 FROM schema_migrations WHERE version = $1", migration.version);
+            if (!done.empty()) {
+                continue;
+            }
+            txn.exec(migration.sql);
+            txn.exec_params("INSERT INTO schema_migrations (version, name) VALUES ($1, $2)",
+                            migration.version, migration.name);
+            txn.commit();
+            std::cout << "Applied migration " << migration.version << ": "
+                      << migration.name << std::endl;
+            applied++;
+        }
+        return applied;
+    }
+};
+
+// Фоновая часть миграции full_text_search, которой не место в транзакции
+// при старте: заполнение search_vector у старых строк короткими пачками и
+// CREATE INDEX CONCURRENTLY (он не блокирует запись, но не работает в
+// транзакции). Пока индекса нет, поиск идет без него, а незаполненные
+// строки в выдачу не попадают.
+class SearchIndexBuilder {
+private:
+    struct SearchIndex {
+        const char* name;
+        const char* table;
+        const char* id_column;
+        const char* backfill;   // $1, $2 - диапазон id пачки
+        const char* create;
+    };
+
+    static constexpr SearchIndex INDEXES[] = {
+        {"idx_films_search", "films", "film_id",
+            "UPDATE films SET search_vector = film_search_vector(film_id, title, director_id) "
+            "WHERE film_id BETWEEN $1 AND $2 AND search_vector IS NULL",
+            "CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_films_search ON films USING GIN (search_vector)"},
+        {"idx_reviews_search", "reviews", "review_id",
+            "UPDATE reviews SET search_vector = to_tsvector('english', coalesce(comment, '')) "
+            "WHERE review_id BETWEEN $1 AND $2 AND search_vector IS NULL",
+            "CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_reviews_search ON reviews USING GIN (search_vector)"},
+    };
+
+    static constexpr long BACKFILL_BATCH_IDS = 10000;
+
+    pqxx::connection& conn;
+    const std::atomic<bool>& stopping;
+
+public:
+    SearchIndexBuilder(pqxx::connection& connection, const std::atomic<bool>& stop)
+        : conn(connection), stopping(stop) {}
+
+    void build() {
+        pqxx::nontransaction session(conn);
+        // Блокировка сессии: второй экземпляр приложения просто пропускает работу
+        if (!session.exec("SELECT pg_try_advisory_lock(hashtext('cinema_db.search_indexes'))")[0][0].as<bool>()) {
+            return;
+        }
+        for (const auto& index : INDEXES) {
+            if (stopping) {
+                return;
+            }
+            // Индекс после сбоя CONCURRENTLY остается невалидным, IF NOT EXISTS его не пересоздаст
+            pqxx::result state = session.exec_params(
+                "SELECT indisvalid FROM pg_index WHERE indexrelid = to_regclass($1)", index.name);
+            if (!state.empty() && state[0][0].as<bool>()) {
+                continue;
+            }
+            if (!state.empty()) {
+                session.exec(std::string("DROP INDEX CONCURRENTLY IF EXISTS ") + index.name);
+            }
+            if (!backfill(index)) {
+                return;
+            }
+            session.exec(index.create);
+            std::cout << "Built search index " << index.name << std::endl;
+        }
+    }
+
+private:
+    // Каждая пачка - отдельная транзакция, чтобы не держать блокировки строк
+    bool backfill(const SearchIndex& index) {
+        long max_id = 0;
+        {
+            pqxx::read_transaction txn(conn);
+            max_id = txn.exec(std::string("SELECT COALESCE(MAX(") + index.id_column + "), 0) FROM " +
+                              index.table)[0][0].as<long>();
+        }
+        for (long from = 0; from <= max_id; from += BACKFILL_BATCH_IDS) {
+            if (stopping) {
+                return false;
+            }
+            pqxx::work txn(conn);
+            txn.exec_params(index.backfill, from, from + BACKFILL_BATCH_IDS - 1);
+            txn.commit();
+        }
+        return true;
+    }
+};
+
+// Один узел плана из EXPLAIN (FORMAT JSON, ANALYZE, BUFFERS)
+struct PlanNode {
+    std::string node_type;
+    std::string relation;
+    // Строки на один проход узла, как их выводит EXPLAIN
+    double plan_rows = 0;
+    double plan_width = 0;   // средняя ширина строки в байтах
+    double actual_rows = 0;
+    double loops = 1;
+    long shared_hit = 0;
+    long shared_read = 0;
+    bool filtered = false;     // есть Filter: строки отбираются после чтения
+    bool index_cond = false;   // есть Index Cond или Recheck Cond
+};
+
+// Снимок плана одного запроса: форма, строки, буферы и время выполнения
+struct PlanSnapshot {
+    std::string shape;
+    double execution_ms = 0;
+    long shared_hit = 0;
+    long shared_read = 0;
+    double plan_rows = 0;
+    double actual_rows = 0;
+};
+
+// Проверка планов запросов из реестра STATEMENTS: сохраняет базовую линию
+// в файл и сравнивает с ней последующие прогоны.
+class QueryPlanInspector {
+private:
+    pqxx::connection& conn;
+    std::string baseline_path;
+
+public:
+    // Seq Scan по таблице с таким числом строк считаем проблемой
+    static constexpr double LARGE_TABLE_ROWS = 10000;
+    // Регрессия по времени: медленнее базовой линии в N раз и минимум на M мс
+    static constexpr double RUNTIME_REGRESSION_RATIO = 1.5;
+    static constexpr double RUNTIME_REGRESSION_MIN_MS = 1.0;
+    // Ошибка оценки строк планировщиком, после которой выводим предупреждение
+    static constexpr double ROW_ESTIMATE_ERROR_RATIO = 10.0;
+
+    QueryPlanInspector(pqxx::connection& connection, const std::string& baseline_file)
+        : conn(connection), baseline_path(baseline_file) {}
+
+    // Прогоняет все запросы реестра, сравнивает с базовой линией и
+    // возвращает количество найденных проблем
+    int run(bool save_baseline) {
+        std::map<std::string, PlanSnapshot> baseline = loadBaseline();
+        std::map<std::string, PlanSnapshot> current;
+        int problems = 0;
+
+        std::cout << "\n=== Query Plan Inspection ===" << std::endl;
+        if (baseline.empty()) {
+            std::cout << "No baseline found in " << baseline_path
+                      << ", current plans will be recorded." << std::endl;
+            save_baseline = true;
+        }
+
+        for (const auto& stmt : STATEMENTS) {
+            std::vector<PlanNode> nodes;
+            PlanSnapshot snap;
+            try {
+                snap = explain(stmt, nodes);
+            } catch (const std::exception &e) {
+                std::cout << "\n[" << stmt.name << "] EXPLAIN failed: " << e.what() << std::endl;
+                problems++;
+                continue;
+            }
+            current[stmt.name] = snap;
+
+            std::cout << "\n[" << stmt.name << "] " << std::fixed << std::setprecision(2)
+                      << snap.execution_ms << " ms, rows est/actual "
+                      << std::setprecision(0) << snap.plan_rows << "/" << snap.actual_rows
+                      << ", buffers hit/read " << snap.shared_hit << "/" << snap.shared_read << std::endl;
+            std::cout << "  plan: " << snap.shape << std::endl;
+
+            // Строки сравниваются на один проход: внутренняя сторона Nested Loop
+            // по маленькой таблице не становится "большой" из-за числа проходов
+            for (const auto& node : nodes) {
+                double rows = std::max(node.plan_rows, node.actual_rows);
+                if (node.node_type == "Seq Scan" && rows >= LARGE_TABLE_ROWS) {
+                    std::cout << "  WARNING: Seq Scan on large table " << node.relation
+                              << " (" << std::setprecision(0) << rows << " rows)" << std::endl;
+                    problems++;
+                }
+                if (stmt.read_only && node.plan_rows > 0 && node.actual_rows > 0) {
+                    double error = std::max(node.plan_rows / node.actual_rows,
+                                            node.actual_rows / node.plan_rows);
+                    if (error >= ROW_ESTIMATE_ERROR_RATIO) {
+                        std::cout << "  WARNING: row estimate off by " << std::setprecision(1) << error
+                                  << "x at " << node.node_type
+                                  << (node.relation.empty() ? "" : " on " + node.relation) << std::endl;
+                    }
+                }
+            }
+
+            auto it = baseline.find(stmt.name);
+            if (it == baseline.end()) {
+                continue;
+            }
+            const PlanSnapshot& base = it->second;
+            if (base.shape != snap.shape) {
+                std::cout << "  CHANGED: plan shape differs from baseline" << std::endl;
+                std::cout << "    was: " << base.shape << std::endl;
+                problems++;
+            }
+            if (stmt.read_only && snap.execution_ms > base.execution_ms * RUNTIME_REGRESSION_RATIO &&
+                snap.execution_ms - base.execution_ms > RUNTIME_REGRESSION_MIN_MS) {
+                std::cout << "  REGRESSION: " << std::setprecision(2) << base.execution_ms
+                          << " ms -> " << snap.execution_ms << " ms" << std::endl;
+                problems++;
+            }
+            if (stmt.read_only && estimateError(snap) >= ROW_ESTIMATE_ERROR_RATIO &&
+                estimateError(base) < ROW_ESTIMATE_ERROR_RATIO) {
+                std::cout << "  REGRESSION: row estimate/actual " << std::setprecision(0)
+                          << base.plan_rows << "/" << base.actual_rows << " -> "
+                          << snap.plan_rows << "/" << snap.actual_rows << std::endl;
+                problems++;
+            } else if (base.plan_rows != snap.plan_rows || base.actual_rows != snap.actual_rows) {
+                std::cout << "  rows est/actual: " << std::setprecision(0)
+                          << base.plan_rows << "/" << base.actual_rows << " -> "
+                          << snap.plan_rows << "/" << snap.actual_rows << std::endl;
+            }
+            if (base.shared_hit + base.shared_read != snap.shared_hit + snap.shared_read) {
+                std::cout << "  buffers: " << base.shared_hit << "/" << base.shared_read
+                          << " -> " << snap.shared_hit << "/" << snap.shared_read << std::endl;
+            }
+        }
+
+        std::cout << "\nProblems found: " << problems << std::endl;
+        if (save_baseline) {
+            saveBaseline(current);
+            std::cout << "Baseline saved to " << baseline_path << std::endl;
+        }
+        return problems;
+    }
+
+    // Проверяет, что у каждого читающего запроса есть план на индексах.
+    // Seq Scan запрещается только для этой проверки: на маленьких таблицах
+    // планировщик и так выберет его, а нас интересует, есть ли альтернатива.
+    // Без Seq Scan планировщик может пройти индекс целиком и отфильтровать
+    // строки после чтения, поэтому условие отбора по таблице должно попасть
+    // в Index Cond или Recheck Cond.
+    int checkIndexUsage() {
+        int missing = 0;
+        for (const auto& stmt : STATEMENTS) {
+            if (!stmt.read_only) {
+                continue;
+            }
+            try {
+                std::string sql = "EXPLAIN (FORMAT JSON) " + executedForm(stmt);
+                pqxx::work txn(conn);
+                txn.exec(CURSOR_SETTINGS);
+                txn.exec("SET LOCAL enable_seqscan = off");
+                std::string json;
+                for (const auto& row : txn.exec(sql)) {
+                    json += row[0].c_str();
+                }
+                txn.abort();
+
+                std::vector<PlanNode> nodes;
+                PlanSnapshot snap;
+                parsePlan(json, nodes, snap);
+                for (const auto& node : nodes) {
+                    if (node.relation.empty()) {
+                        continue;
+                    }
+                    if (node.node_type == "Seq Scan") {
+                        std::cerr << "Warning: query " << stmt.name << " has no index-backed plan for "
+                                  << node.relation << std::endl;
+                        missing++;
+                    } else if (node.filtered && !node.index_cond) {
+                        std::cerr << "Warning: query " << stmt.name << " filters " << node.relation
+                                  << " without an index condition (" << node.node_type << ")" << std::endl;
+                        missing++;
+                    }
+                }
+            } catch (const std::exception &e) {
+                std::cerr << "Warning: could not check plan for " << stmt.name << ": " << e.what() << std::endl;
+                missing++;
+            }
+        }
+        return missing;
+    }
+
+private:
+    // Во сколько раз оценка строк корня плана расходится с фактом
+    static double estimateError(const PlanSnapshot& snap) {
+        if (snap.plan_rows <= 0 || snap.actual_rows <= 0) {
+            return 1;
+        }
+        return std::max(snap.plan_rows / snap.actual_rows, snap.actual_rows / snap.plan_rows);
+    }
+
+    // Запрос с тестовыми аргументами из реестра в той форме, в которой его
+    // выполняет приложение: EXECUTE подготовленного запроса или, для
+    // неограниченного, объявление курсора
+    static std::string executedForm(const StatementDef& stmt) {
+        if (stmt.unbounded) {
+            return declareCursor("plan_cursor", inlineSampleArgs(stmt));
+        }
+        std::string sql = std::string("EXECUTE ") + stmt.name;
+        if (stmt.sample_args[0] != '\0') {
+            sql += std::string("(") + stmt.sample_args + ")";
+        }
+        return sql;
+    }
+
+    // Текст запроса с тестовыми аргументами вместо $1, $2, ... Аргументы -
+    // литералы без типа, как и параметры, которые передает курсору приложение
+    static std::string inlineSampleArgs(const StatementDef& stmt) {
+        std::vector<std::string> args;
+        std::string arg;
+        bool quoted = false;
+        for (const char* p = stmt.sample_args; *p != '\0'; p++) {
+            if (*p == '\'') {
+                quoted = !quoted;
+            } else if (*p == ',' && !quoted) {
+                args.push_back(arg);
+                arg.clear();
+                continue;
+            }
+            arg += *p;
+        }
+        if (!arg.empty()) {
+            args.push_back(arg);
+        }
+
+        std::string sql;
+        quoted = false;
+        for (const char* p = stmt.sql; *p != '\0'; p++) {
+            if (*p == '\'') {
+                quoted = !quoted;
+            } else if (*p == '$' && !quoted && p[1] >= '0' && p[1] <= '9') {
+                size_t index = 0;
+                while (p[1] >= '0' && p[1] <= '9') {
+                    index = index * 10 + (*++p - '0');
+                }
+                if (index == 0 || index > args.size()) {
+                    throw std::logic_error(std::string("no sample argument $") + std::to_string(index) +
+                                           " for " + stmt.name);
+                }
+                sql += "(" + args[index - 1] + ")";
+                continue;
+            }
+            sql += *p;
+        }
+        return sql;
+    }
+
+    PlanSnapshot explain(const StatementDef& stmt, std::vector<PlanNode>& nodes) {
+        // Пишущие запросы не выполняем, для них доступна только форма плана
+        std::string sql = stmt.read_only ? "EXPLAIN (FORMAT JSON, ANALYZE, BUFFERS) "
+                                         : "EXPLAIN (FORMAT JSON) ";
+        sql += executedForm(stmt);
+
+        // Транзакция не фиксируется, чтобы ANALYZE не оставлял следов
+        pqxx::work txn(conn);
+        txn.exec(CURSOR_SETTINGS);
+        pqxx::result r = txn.exec(sql);
+        std::string json;
+        for (const auto& row : r) {
+            json += row[0].c_str();
+        }
+        txn.abort();
+
+        PlanSnapshot snap;
+        parsePlan(json, nodes, snap);
+        return snap;
+    }
+
+public:
+    // Разбор JSON-плана без полноценного парсера: PostgreSQL выводит атрибуты
+    // узла раньше его дочерних "Plans", поэтому ключи между двумя "Node Type"
+    // относятся к последнему встреченному узлу.
+    static void parsePlan(const std::string& json, std::vector<PlanNode>& nodes, PlanSnapshot& snap) {
+        size_t pos = 0;
+        while ((pos = json.find('"', pos)) != std::string::npos) {
+            size_t key_end = json.find('"', pos + 1);
+            if (key_end == std::string::npos) {
+                break;
+            }
+            std::string key = json.substr(pos + 1, key_end - pos - 1);
+            pos = key_end + 1;
+            size_t colon = json.find_first_not_of(" \t\r\n", pos);
+            if (colon == std::string::npos || json[colon] != ':') {
+                continue;
+            }
+            size_t value_start = json.find_first_not_of(" \t\r\n", colon + 1);
+            if (value_start == std::string::npos) {
+                break;
+            }
+            std::string value;
+            if (json[value_start] == '"') {
+                size_t value_end = value_start + 1;
+                while (value_end < json.size() && json[value_end] != '"') {
+                    value_end += (json[value_end] == '\\') ? 2 : 1;
+                }
+                value = json.substr(value_start + 1, value_end - value_start - 1);
+                pos = value_end + 1;
+            } else {
+                size_t value_end = json.find_first_of(",}] \t\r\n", value_start);
+                value = json.substr(value_start, value_end - value_start);
+                pos = value_end;
+            }
+
+            if (key == "Node Type") {
+                nodes.emplace_back();
+                nodes.back().node_type = value;
+            } else if (key == "Execution Time") {
+                snap.execution_ms = std::stod(value);
+            } else if (nodes.empty()) {
+                continue;
+            } else if (key == "Relation Name") {
+                nodes.back().relation = value;
+            } else if (key == "Plan Rows") {
+                nodes.back().plan_rows = std::stod(value);
+            } else if (key == "Plan Width") {
+                nodes.back().plan_width = std::stod(value);
+            } else if (key == "Actual Loops") {
+                nodes.back().loops = std::stod(value);
+            } else if (key == "Actual Rows") {
+                nodes.back().actual_rows = std::stod(value);
+            } else if (key == "Shared Hit Blocks") {
+                nodes.back().shared_hit = std::stol(value);
+            } else if (key == "Shared Read Blocks") {
+                nodes.back().shared_read = std::stol(value);
+            } else if (key == "Filter") {
+                nodes.back().filtered = true;
+            } else if (key == "Index Cond" || key == "Recheck Cond") {
+                nodes.back().index_cond = true;
+            }
+        }
+
+        for (const auto& node : nodes) {
+            if (!snap.shape.empty()) {
+                snap.shape += " > ";
+            }
+            snap.shape += node.node_type;
+            if (!node.relation.empty()) {
+                snap.shape += "(" + node.relation + ")";
+            }
+        }
+        if (!nodes.empty()) {
+            // Буферы корневого узла уже включают буферы всех дочерних
+            snap.plan_rows = nodes.front().plan_rows;
+            snap.actual_rows = nodes.front().actual_rows * nodes.front().loops;
+            snap.shared_hit = nodes.front().shared_hit;
+            snap.shared_read = nodes.front().shared_read;
+        }
+    }
+
+private:
+    // Формат файла: по строке на запрос, поля разделены табуляцией
+    std::map<std::string, PlanSnapshot> loadBaseline() {
+        std::map<std::string, PlanSnapshot> baseline;
+        std::ifstream in(baseline_path);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string name, exec_ms, hit, read, plan_rows, actual_rows, shape;
+            if (std::getline(fields, name, '\t') && std::getline(fields, exec_ms, '\t') &&
+                std::getline(fields, hit, '\t') && std::getline(fields, read, '\t') &&
+                std::getline(fields, plan_rows, '\t') && std::getline(fields, actual_rows, '\t') &&
+                std::getline(fields, shape)) {
+                PlanSnapshot& snap = baseline[name];
+                snap.execution_ms = std::stod(exec_ms);
+                snap.shared_hit = std::stol(hit);
+                snap.shared_read = std::stol(read);
+                snap.plan_rows = std::stod(plan_rows);
+                snap.actual_rows = std::stod(actual_rows);
+                snap.shape = shape;
+            }
+        }
+        return baseline;
+    }
+
+    void saveBaseline(const std::map<std::string, PlanSnapshot>& plans) {
+        std::ofstream out(baseline_path, std::ios::trunc);
+        // Без полной точности большие числа строк пишутся как 1.23457e+06
+        // и при сравнении с базовой линией дают ложный дрейф
+        out << std::setprecision(17);
+        for (const auto& entry : plans) {
+            const PlanSnapshot& snap = entry.second;
+            out << entry.first << '\t' << snap.execution_ms << '\t'
+          << snap.shared_hit << '\t' << snap.shared_read << '\t'
+          << snap.plan_rows << '\t' << snap.actual_rows << '\t'
+          << snap.shape << '\n';
+        }
+    }
+};
+
+// Подготовка всех запросов реестра: план разбирается один раз на соединение
+static void prepareStatements(pqxx::connection& connection) {
+    for (const auto& stmt : STATEMENTS) {
+        connection.prepare(stmt.name, stmt.sql);
+    }
+}
+
+// Пул соединений для параллельных запросов. Соединения открываются по
+// мере надобности и сразу получают подготовленные запросы.
+class ConnectionPool {
+private:
+    std::string connection_string;
+    size_t max_size;
+    std::vector<std::unique_ptr<pqxx::connection>> idle;
+    size_t opened = 0;
+    std::mutex mutex;
+    std::condition_variable available;
+
+public:
+    // Возвращает соединение в пул при выходе из области видимости
+    class Lease {
+    private:
+        ConnectionPool* pool;
+        std::unique_ptr<pqxx::connection> conn;
+        bool detached = false;
+
+    public:
+        Lease(ConnectionPool* owner, std::unique_ptr<pqxx::connection> connection)
+            : pool(owner), conn(std::move(connection)) {}
+        Lease(Lease&&) = default;
+        ~Lease() {
+            if (conn) {
+                pool->release(std::move(conn), detached);
+            }
+        }
+        pqxx::connection& operator*() { return *conn; }
+
+        // Освобождает место в пуле, пока соединение занято надолго, чтобы
+        // другие запросы его не ждали. При возврате соединение остается в
+        // пуле, только если в нем снова есть место.
+        void detach() {
+            if (!detached) {
+                detached = true;
+                pool->detach();
+            }
+        }
+    };
+
+    ConnectionPool(const std::string& conn_string, size_t size)
+        : connection_string(conn_string), max_size(size) {}
+
+    Lease acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return !idle.empty() || opened < max_size; });
+        if (!idle.empty()) {
+            std::unique_ptr<pqxx::connection> conn = std::move(idle.back());
+            idle.pop_back();
+            return Lease(this, std::move(conn));
+        }
+        opened++;
+        lock.unlock();
+        try {
+            auto conn = std::make_unique<pqxx::connection>(connection_string);
+            prepareStatements(*conn);
+            return Lease(this, std::move(conn));
+        } catch (...) {
+            lock.lock();
+            opened--;
+            available.notify_one();
+            throw;
+        }
+    }
+
+    size_t capacity() const { return max_size; }
+
+    // Заранее открывает одно соединение, если пул еще не заполнен
+    void preopen() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (opened >= max_size) {
+                return;
+            }
+            opened++;
+        }
+        std::unique_ptr<pqxx::connection> conn;
+        try {
+            conn = std::make_unique<pqxx::connection>(connection_string);
+            prepareStatements(*conn);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            opened--;
+            available.notify_one();
+            throw;
+        }
+        release(std::move(conn));
+    }
+
+private:
+    void detach() {
+        std::lock_guard<std::mutex> lock(mutex);
+        opened--;
+        available.notify_one();
+    }
+
+    void release(std::unique_ptr<pqxx::connection> conn, bool detached = false) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (detached) {
+            if (!conn->is_open() || opened >= max_size) {
+                return;
+            }
+            opened++;
+        }
+        if (conn->is_open()) {
+            idle.push_back(std::move(conn));
+        } else {
+            opened--;
+        }
+        available.notify_one();
+    }
+};
+
+// Пул потоков с перехватом задач (work stealing). У каждого потока своя
+// очередь: владелец берет задачи с конца, остальные воруют с начала.
+// Задача запускается, когда выполнены все задачи, от которых она зависит.
+class TaskScheduler {
+public:
+    struct Task {
+        std::function<void()> fn;
+        std::atomic<int> pending{0};
+        std::vector<std::shared_ptr<Task>> dependents;
+        std::exception_ptr error;
+        bool done = false;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    using TaskPtr = std::shared_ptr<Task>;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<TaskPtr> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> next_queue{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+
+    static thread_local TaskScheduler* current_scheduler;
+    static thread_local size_t current_worker;
+
+public:
+    explicit TaskScheduler(size_t threads) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; i++) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Создает задачу, которая выполнится после всех задач из deps
+    TaskPtr submit(std::function<void()> fn, const std::vector<TaskPtr>& deps = {}) {
+        TaskPtr task = std::make_shared<Task>();
+        task->fn = std::move(fn);
+        // Лишняя единица не дает задаче стартовать, пока зависимости регистрируются
+        task->pending = static_cast<int>(deps.size()) + 1;
+        for (const auto& dep : deps) {
+            std::lock_guard<std::mutex> lock(dep->mutex);
+            if (dep->done) {
+                task->pending--;
+            } else {
+                dep->dependents.push_back(task);
+            }
+        }
+        if (--task->pending == 0) {
+            schedule(task);
+        }
+        return task;
+    }
+
+    // Ждет завершения задачи и пробрасывает ее исключение
+    void wait(const TaskPtr& task) {
+        std::unique_lock<std::mutex> lock(task->mutex);
+        task->finished.wait(lock, [&task] { return task->done; });
+        if (task->error) {
+            std::rethrow_exception(task->error);
+        }
+    }
+
+private:
+    void schedule(const TaskPtr& task) {
+        size_t index = (current_scheduler == this)
+            ? current_worker
+            : next_queue.fetch_add(1) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    TaskPtr take(size_t index) {
+        {
+            WorkerQueue& own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                TaskPtr task = own.tasks.back();
+                own.tasks.pop_back();
+                return task;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            WorkerQueue& victim = *queues[(index + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                TaskPtr task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void workerLoop(size_t index) {
+        current_scheduler = this;
+        current_worker = index;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                wake.wait(lock, [this] { return queued > 0 || stopping; });
+                if (queued == 0 && stopping) {
+                    return;
+                }
+            }
+            TaskPtr task = take(index);
+            if (!task) {
+                continue;
+            }
+            queued--;
+            run(task);
+        }
+    }
+
+    void run(const TaskPtr& task) {
+        try {
+            task->fn();
+        } catch (...) {
+            task->error = std::current_exception();
+        }
+        std::vector<TaskPtr> ready;
+        {
+            std::lock_guard<std::mutex> lock(task->mutex);
+            task->done = true;
+            for (auto& dependent : task->dependents) {
+                if (--dependent->pending == 0) {
+                    ready.push_back(dependent);
+                }
+            }
+            task->dependents.clear();
+        }
+        task->finished.notify_all();
+        for (const auto& dependent : ready) {
+            schedule(dependent);
+        }
+    }
+};
+
+thread_local TaskScheduler* TaskScheduler::current_scheduler = nullptr;
+thread_local size_t TaskScheduler::current_worker = 0;
+
+// Объединение одинаковых одновременных запросов (single-flight): пока
+// запрос с теми же параметрами выполняется, остальные вызовы ждут его
+// результат вместо того, чтобы идти в базу повторно. Результатом может быть
+// любое копируемое значение; тип определяется ключом.
+class SingleFlight {
+private:
+    struct Call {
+        bool done = false;
+        std::any result;
+        std::exception_ptr error;
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::map<std::string, std::shared_ptr<Call>> calls;
+    std::atomic<unsigned long> executed{0};
+    std::atomic<unsigned long> coalesced{0};
+
+public:
+    template<typename Fn>
+    auto run(const std::string& key, const Fn& fn) -> decltype(fn()) {
+        using Result = decltype(fn());
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = calls.find(key);
+        if (it != calls.end()) {
+            std::shared_ptr<Call> call = it->second;
+            coalesced++;
+            finished.wait(lock, [&call] { return call->done; });
+            if (call->error) {
+                std::rethrow_exception(call->error);
+            }
+            return std::any_cast<Result>(call->result);
+        }
+
+        auto call = std::make_shared<Call>();
+        calls[key] = call;
+        executed++;
+        lock.unlock();
+
+        try {
+            call->result = fn();
+        } catch (...) {
+            call->error = std::current_exception();
+        }
+
+        lock.lock();
+        call->done = true;
+        calls.erase(key);
+        lock.unlock();
+        finished.notify_all();
+
+        if (call->error) {
+            std::rethrow_exception(call->error);
+        }
+        return std::any_cast<Result>(call->result);
+    }
+
+    unsigned long executedCalls() const { return executed; }
+    unsigned long coalescedCalls() const { return coalesced; }
+
+    size_t inFlight() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return calls.size();
+    }
+};
+
+// Примерный размер узла std::map/std::set без значения (указатели и цвет)
+constexpr size_t TREE_NODE_BYTES = 4 * sizeof(void*);
+
+// Топ фильмов по кассовым сборам в памяти. Хранит ограниченное число
+// лучших фильмов, упорядоченных по (box_office, film_id); изменения
+// применяются точечно, база перечитывается, только если из топа выпало
+// столько фильмов, что первые max_k уже нельзя восстановить.
+class TopGrossingLeaderboard {
+public:
+    struct Entry {
+        int film_id;
+        std::string title;
+        int release_year;
+        double box_office;
+        double budget;
+        std::string director;
+    };
+
+private:
+    using Key = std::pair<double, int>;
+
+    size_t max_k;
+    size_t bound;  // запас сверху, чтобы удаления не требовали сразу перечитывать базу
+    std::set<Key, std::greater<Key>> order;
+    std::map<int, Entry> entries;
+    bool seeded = false;
+    bool complete = false;  // в памяти все подходящие фильмы, ниже границы ничего нет
+    std::mutex mutex;
+
+    // Условие отбора то же, что у запроса top_grossing
+    static bool qualifies(const Entry& entry) {
+        return entry.box_office > 0 && entry.budget > 0;
+    }
+
+    void eraseLocked(int film_id) {
+        auto it = entries.find(film_id);
+        if (it != entries.end()) {
+            order.erase(Key(it->second.box_office, film_id));
+            entries.erase(it);
+        }
+    }
+
+    // Инвариант: в памяти есть все подходящие фильмы не ниже последнего
+    // элемента order. Если фильмы ниже границы в базе есть (!complete),
+    // вставить фильм ниже последнего элемента нельзя: между ними могут
+    // оказаться фильмы, которых нет в памяти.
+    void insertLocked(const Entry& entry) {
+        Key key(entry.box_office, entry.film_id);
+        bool below_last = order.empty() || key < *order.rbegin();
+        if (below_last && (!complete || order.size() >= bound)) {
+            complete = false;
+            return;
+        }
+        order.insert(key);
+        entries[entry.film_id] = entry;
+        if (order.size() > bound) {
+            Key last = *order.rbegin();
+            order.erase(last);
+            entries.erase(last.second);
+            complete = false;
+        }
+    }
+
+public:
+    explicit TopGrossingLeaderboard(size_t k) : max_k(k), bound(k * 2) {}
+
+    size_t maxK() const { return max_k; }
+    size_t seedLimit() const { return bound; }
+
+    bool isSeeded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return seeded;
+    }
+
+    // Примерный объем памяти топа: узлы деревьев и строки записей
+    size_t memoryBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = order.size() * (TREE_NODE_BYTES + sizeof(Key));
+        for (const auto& item : entries) {
+            bytes += TREE_NODE_BYTES + sizeof(item) + item.second.title.capacity() +
+                     item.second.director.capacity();
+        }
+        return bytes;
+    }
+
+    bool needsSeed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !seeded || (!complete && order.size() < max_k);
+    }
+
+    // rows упорядочены по убыванию сборов и ограничены seedLimit()
+    void seed(const std::vector<Entry>& rows) {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.clear();
+        entries.clear();
+        for (const auto& entry : rows) {
+            order.insert(Key(entry.box_office, entry.film_id));
+            entries[entry.film_id] = entry;
+        }
+        complete = rows.size() < bound;
+        seeded = true;
+    }
+
+    // Полное состояние для снимка каталога
+    void exportState(std::vector<Entry>& rows, bool& all_films) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rows.clear();
+        for (const auto& key : order) {
+            rows.push_back(entries[key.second]);
+        }
+        all_films = complete;
+    }
+
+    void restore(const std::vector<Entry>& rows, bool all_films) {
+        seed(rows);
+        std::lock_guard<std::mutex> lock(mutex);
+        complete = all_films;
+    }
+
+    void upsert(const Entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!seeded) {
+            return;
+        }
+        eraseLocked(entry.film_id);
+        if (qualifies(entry)) {
+            insertLocked(entry);
+        }
+    }
+
+    void remove(int film_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        eraseLocked(film_id);
+    }
+
+    // Возвращает false, если фильма нет в памяти и нужна полная строка из базы
+    bool updateBoxOffice(int film_id, double box_office) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(film_id);
+        if (it == entries.end()) {
+            return false;
+        }
+        Entry entry = it->second;
+        entry.box_office = box_office;
+        eraseLocked(film_id);
+        if (qualifies(entry)) {
+            insertLocked(entry);
+        }
+        return true;
+    }
+
+    std::vector<Entry> top(size_t k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Entry> result;
+        result.reserve(std::min(k, order.size()));
+        for (auto it = order.begin(); it != order.end() && result.size() < k; ++it) {
+            result.push_back(entries[it->second]);
+        }
+        return result;
+    }
+};
+
+// Собирает film_id из уведомлений канала films_changed или reviews_changed
+class ChangeListener : public pqxx::notification_receiver {
+private:
+    const std::atomic<int>& own_backend_pid;
+
+public:
+    std::vector<int> changed;
+
+    // own_pid - соединение, через которое пишет само приложение
+    ChangeListener(pqxx::connection& listen_conn, const std::string& channel, const std::atomic<int>& own_pid)
+        : pqxx::notification_receiver(listen_conn, channel), own_backend_pid(own_pid) {}
+
+    void operator()(const std::string& payload, int backend_pid) override {
+        // Свои изменения уже применены к данным в памяти напрямую
+        if (backend_pid != own_backend_pid) {
+            changed.push_back(std::stoi(payload));
+        }
+    }
+};
+
+// Ограниченная очередь без блокировок для многих производителей и
+// потребителей (схема Дмитрия Вьюкова). Емкость округляется вверх до
+// степени двойки; tryPush возвращает false, если очередь заполнена.
+template<typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> buffer;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = buffer[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = buffer[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Позиция постраничного поиска: ранг и id последней показанной строки
+struct SearchPage {
+    std::string last_rank = "Infinity";
+    int last_id = 2147483647;
+    // Ранжировать только столько самых новых совпадений; 0 - все совпадения
+    int max_matches = 0;
+    // Выставляется поиском: совпадений больше max_matches, старые не показаны
+    bool capped = false;
+};
+
+struct Review {
+    int film_id = 0;
+    std::string reviewer_name;
+    double rating = 0;
+    std::string comment;
+};
+
+// Скользящие агрегаты рейтингов по фильмам: количество, сумма, минимум и
+// максимум. Заполняются из базы один раз и дальше обновляются конвейером
+// приема отзывов, а изменения других клиентов приходят через reviews_changed.
+class RatingAggregates {
+public:
+    struct FilmRating {
+        std::string title;
+        long count = 0;
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+    };
+
+private:
+    std::map<int, FilmRating> films;
+    bool seeded = false;
+    std::mutex mutex;
+
+public:
+    bool isSeeded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return seeded;
+    }
+
+    void seed(const std::map<int, FilmRating>& rows) {
+        std::lock_guard<std::mutex> lock(mutex);
+        films = rows;
+        seeded = true;
+    }
+
+    void add(int film_id, double rating) {
+        std::lock_guard<std::mutex> lock(mutex);
+        FilmRating& film = films[film_id];
+        film.min = film.count == 0 ? rating : std::min(film.min, rating);
+        film.max = film.count == 0 ? rating : std::max(film.max, rating);
+        film.count++;
+        film.sum += rating;
+    }
+
+    // Заменяет агрегаты указанных фильмов прочитанными из базы; фильмы
+    // без строки в rows (отзывов больше нет) из агрегатов убираются
+    void replace(const std::vector<int>& film_ids, const std::map<int, FilmRating>& rows) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int film_id : film_ids) {
+            auto row = rows.find(film_id);
+            if (row == rows.end()) {
+                films.erase(film_id);
+            } else {
+                films[film_id] = row->second;
+            }
+        }
+    }
+
+    void setTitle(int film_id, const std::string& title) {
+        std::lock_guard<std::mutex> lock(mutex);
+        films[film_id].title = title;
+    }
+
+    std::map<int, FilmRating> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return films;
+    }
+
+    size_t memoryBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        for (const auto& item : films) {
+            bytes += TREE_NODE_BYTES + sizeof(item) + item.second.title.capacity();
+        }
+        return bytes;
+    }
+};
+
+// Конвейер приема отзывов: очередь -> запись пачками через COPY ->
+// обновление агрегатов. Агрегаты обновляются только после фиксации
+// пачки, поэтому они не опережают содержимое базы.
+class ReviewIngestionPipeline {
+private:
+    struct RatingEvent {
+        int film_id = 0;
+        double rating = 0;
+    };
+
+    static constexpr size_t MAX_BATCH = 5000;
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(5);
+
+    std::string connection_string;
+    RatingAggregates& aggregates;
+    std::atomic<int>& backend_pid;
+    BoundedQueue<Review> reviews{1 << 16};
+    BoundedQueue<RatingEvent> ratings{1 << 16};
+    std::thread writer;
+    std::thread aggregator;
+    std::atomic<bool> stopping{false};
+    bool writer_done = false;
+
+    // Пустые очереди потоки ждут на условных переменных; счетчики
+    // submitted/published меняются под мьютексом, чтобы не терять пробуждения
+    std::mutex reviews_mutex;
+    std::condition_variable reviews_ready;
+    std::mutex events_mutex;
+    std::condition_variable events_ready;
+    std::condition_variable events_applied;
+    unsigned long published = 0;
+    unsigned long applied = 0;
+    // Держится на время фиксации пачки и публикации ее событий
+    std::mutex commit_mutex;
+
+    std::atomic<unsigned long> submitted{0};
+    std::atomic<unsigned long> written{0};
+    std::atomic<unsigned long> rejected{0};
+    std::atomic<unsigned long> batches{0};
+    std::atomic<long long> write_micros{0};
+
+public:
+    // writer_pid - сюда пишется backend pid соединения писателя, чтобы
+    // уведомления reviews_changed о своих пачках можно было пропускать
+    ReviewIngestionPipeline(const std::string& conn_string, RatingAggregates& film_ratings,
+                            std::atomic<int>& writer_pid)
+        : connection_string(conn_string), aggregates(film_ratings), backend_pid(writer_pid) {
+        writer = std::thread([this] { writerLoop(); });
+        aggregator = std::thread([this] { aggregatorLoop(); });
+    }
+
+    // Дожидается записи всего, что уже было в очереди
+    ~ReviewIngestionPipeline() {
+        {
+            std::lock_guard<std::mutex> lock(reviews_mutex);
+            stopping = true;
+        }
+        reviews_ready.notify_all();
+        writer.join();
+        aggregator.join();
+        backend_pid = 0;
+    }
+
+    // Если очередь заполнена, вызывающий поток ждет (обратное давление)
+    void submit(Review review) {
+        while (!reviews.tryPush(review)) {
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard<std::mutex> lock(reviews_mutex);
+            submitted++;
+        }
+        reviews_ready.notify_one();
+    }
+
+    // Выполняет fn, когда события всех зафиксированных пачек уже применены
+    // к агрегатам, и не дает писателю фиксировать новые, пока fn работает.
+    // Так перечитанные из базы агрегаты не расходятся с дельтами конвейера.
+    template<typename Fn>
+    void quiesce(Fn fn) {
+        std::lock_guard<std::mutex> commit_lock(commit_mutex);
+        {
+            std::unique_lock<std::mutex> lock(events_mutex);
+            events_applied.wait(lock, [this] { return applied == published; });
+        }
+        fn();
+    }
+
+    unsigned long submittedCount() const { return submitted; }
+    unsigned long writtenCount() const { return written; }
+    unsigned long rejectedCount() const { return rejected; }
+    unsigned long batchCount() const { return batches; }
+
+    // Скорость записи в отзывах за секунду работы COPY
+    double reviewsPerSecond() const {
+        long long micros = write_micros;
+        return micros > 0 ? written * 1000000.0 / micros : 0;
+    }
+
+private:
+    void writerLoop() {
+        std::unique_ptr<pqxx::connection> conn;
+        std::vector<Review> batch;
+        Review review;
+        unsigned long taken = 0;
+        auto ready = [&] { return stopping || submitted > taken; };
+        while (true) {
+            batch.clear();
+            auto deadline = std::chrono::steady_clock::now() + FLUSH_INTERVAL;
+            while (batch.size() < MAX_BATCH) {
+                if (reviews.tryPop(review)) {
+                    taken++;
+                    batch.push_back(std::move(review));
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(reviews_mutex);
+                if (batch.empty()) {
+                    reviews_ready.wait(lock, ready);
+                } else if (!reviews_ready.wait_until(lock, deadline, ready)) {
+                    break;
+                }
+                if (stopping && submitted <= taken) {
+                    break;
+                }
+            }
+            if (batch.empty()) {
+                if (stopping) {
+                    break;
+                }
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                if (!conn || !conn->is_open()) {
+                    conn = std::make_unique<pqxx::connection>(connection_string);
+                    prepareStatements(*conn);
+                    backend_pid = conn->backendpid();
+                }
+                writeBatch(*conn, batch);
+            } catch (const std::exception &e) {
+                std::cerr << "Error writing reviews: " << e.what() << std::endl;
+                rejected += batch.size();
+                conn.reset();
+            }
+            write_micros += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            batches++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(events_mutex);
+            writer_done = true;
+        }
+        events_ready.notify_one();
+    }
+
+    // Исключение из writeBatch означает, что не зафиксировано ничего из пачки
+    void writeBatch(pqxx::connection& conn, const std::vector<Review>& batch) {
+        std::vector<const Review*> accepted;
+        try {
+            pqxx::work txn(conn);
+            pqxx::stream_to stream(txn, "reviews",
+                                   std::vector<std::string>{"film_id", "reviewer_name", "rating", "comment"});
+            for (const auto& review : batch) {
+                stream << std::make_tuple(review.film_id, review.reviewer_name, review.rating, review.comment);
+                accepted.push_back(&review);
+            }
+            stream.complete();
+            std::lock_guard<std::mutex> lock(commit_mutex);
+            txn.commit();
+            publish(accepted);
+            return;
+        } catch (const std::exception &) {
+            // COPY отклоняет пачку целиком; ниже отсеиваем только плохие строки
+        }
+
+        accepted.clear();
+        pqxx::work txn(conn);
+        for (const auto& review : batch) {
+            try {
+                pqxx::subtransaction sub(txn);
+                sub.exec_prepared("add_review", review.film_id, review.reviewer_name,
+                                  review.rating, review.comment);
+                sub.commit();
+                accepted.push_back(&review);
+            } catch (const std::exception &) {
+            }
+        }
+        std::lock_guard<std::mutex> lock(commit_mutex);
+        txn.commit();
+        // Отклоненные строки считаются только после фиксации, иначе при
+        // ошибке COMMIT они попали бы в rejected второй раз вместе с пачкой
+        rejected += batch.size() - accepted.size();
+        publish(accepted);
+    }
+
+    // Вызывается под commit_mutex сразу после фиксации пачки
+    void publish(const std::vector<const Review*>& committed) {
+        for (const Review* review : committed) {
+            RatingEvent event{review->film_id, review->rating};
+            while (!ratings.tryPush(event)) {
+                std::this_thread::yield();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(events_mutex);
+            published += committed.size();
+        }
+        events_ready.notify_one();
+        written += committed.size();
+    }
+
+    void aggregatorLoop() {
+        RatingEvent event;
+        while (true) {
+            unsigned long count = 0;
+            while (ratings.tryPop(event)) {
+                aggregates.add(event.film_id, event.rating);
+                count++;
+            }
+            std::unique_lock<std::mutex> lock(events_mutex);
+            applied += count;
+            if (count > 0) {
+                events_applied.notify_all();
+            }
+            // Писатель закончил и все события применены - новых уже не будет
+            if (writer_done && applied == published) {
+                break;
+            }
+            events_ready.wait(lock, [this] { return writer_done || published > applied; });
+        }
+    }
+};
+
+// Снимок каталога в памяти (топ по сборам и агрегаты рейтингов), который
+// пишется при штатном завершении и читается через mmap при быстром старте.
+// fingerprint - отпечаток базы на момент записи, по нему снимок проверяется.
+struct CatalogSnapshot {
+    static constexpr char MAGIC[8] = {'C', 'I', 'N', 'S', 'N', 'A', 'P', '1'};
+
+    std::string fingerprint;
+    bool leaderboard_complete = false;
+    std::vector<TopGrossingLeaderboard::Entry> leaderboard;
+    std::map<int, RatingAggregates::FilmRating> ratings;
+
+    // Запись во временный файл и переименование, чтобы не оставить половину снимка
+    void save(const std::string& path) const {
+        std::string tmp_path = path + ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            out.write(MAGIC, sizeof(MAGIC));
+            writeString(out, fingerprint);
+            writeValue<uint8_t>(out, leaderboard_complete ? 1 : 0);
+            writeValue<uint32_t>(out, leaderboard.size());
+            for (const auto& entry : leaderboard) {
+                writeValue<int32_t>(out, entry.film_id);
+                writeValue<int32_t>(out, entry.release_year);
+                writeValue<double>(out, entry.box_office);
+                writeValue<double>(out, entry.budget);
+                writeString(out, entry.title);
+                writeString(out, entry.director);
+            }
+            writeValue<uint32_t>(out, ratings.size());
+            for (const auto& film : ratings) {
+                writeValue<int32_t>(out, film.first);
+                writeValue<int64_t>(out, film.second.count);
+                writeValue<double>(out, film.second.sum);
+                writeValue<double>(out, film.second.min);
+                writeValue<double>(out, film.second.max);
+                writeString(out, film.second.title);
+            }
+            if (!out) {
+                throw std::runtime_error("Failed to write " + tmp_path);
+            }
+        }
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace " + path);
+        }
+    }
+
+    // Возвращает false, если файла нет; поврежденный файл дает исключение
+    bool load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+
+        try {
+            Reader in{static_cast<const char*>(data), static_cast<const char*>(data) + size};
+            if (std::memcmp(in.take(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0) {
+                throw std::runtime_error("bad snapshot header");
+            }
+            fingerprint = in.readString();
+            leaderboard_complete = in.read<uint8_t>() != 0;
+            leaderboard.resize(in.read<uint32_t>());
+            for (auto& entry : leaderboard) {
+                entry.film_id = in.read<int32_t>();
+                entry.release_year = in.read<int32_t>();
+                entry.box_office = in.read<double>();
+                entry.budget = in.read<double>();
+                entry.title = in.readString();
+                entry.director = in.readString();
+            }
+            uint32_t rating_count = in.read<uint32_t>();
+            for (uint32_t i = 0; i < rating_count; i++) {
+                RatingAggregates::FilmRating& film = ratings[in.read<int32_t>()];
+                film.count = in.read<int64_t>();
+                film.sum = in.read<double>();
+                film.min = in.read<double>();
+                film.max = in.read<double>();
+                film.title = in.readString();
+            }
+        } catch (...) {
+            ::munmap(data, size);
+            throw;
+        }
+        ::munmap(data, size);
+        return true;
+    }
+
+private:
+    // Чтение из отображенной памяти с проверкой границ
+    struct Reader {
+        const char* pos;
+        const char* end;
+
+        const char* take(size_t bytes) {
+            if (static_cast<size_t>(end - pos) < bytes) {
+                throw std::runtime_error("truncated snapshot");
+            }
+            const char* start = pos;
+            pos += bytes;
+            return start;
+        }
+
+        template<typename T>
+        T read() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string readString() {
+            uint32_t length = read<uint32_t>();
+            return std::string(take(length), length);
+        }
+    };
+
+    template<typename T>
+    static void writeValue(std::ostream& out, T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void writeString(std::ostream& out, const std::string& value) {
+        writeValue<uint32_t>(out, value.size());
+        out.write(value.data(), value.size());
+    }
+};
+
+// Уровень надежности записи: Async разрешает не ждать сброса WAL на диск
+// (synchronous_commit = off), подходит для некритичных обновлений
+enum class Durability {
+    Sync,
+    Async
+};
+
+// Координатор записи с групповой фиксацией. Записи из разных потоков
+// собираются в течение короткого окна и выполняются в одной транзакции,
+// каждая в своей подтранзакции: ошибка одной записи не откатывает
+// остальные, а сброс WAL происходит один раз на группу.
+class WriteCoordinator {
+public:
+    using Operation = std::function<pqxx::result(pqxx::transaction_base&)>;
+
+private:
+    struct Request {
+        Operation op;
+        Durability durability;
+        std::promise<pqxx::result> result;
+    };
+
+    static constexpr size_t MAX_GROUP = 256;
+    static constexpr auto GROUP_WINDOW = std::chrono::milliseconds(2);
+
+    std::string connection_string;
+    std::deque<std::unique_ptr<Request>> pending;
+    std::mutex mutex;
+    std::condition_variable arrived;
+    bool stopping = false;
+    std::thread writer;
+    std::atomic<int> backend_pid{0};
+
+    std::atomic<unsigned long> writes{0};
+    std::atomic<unsigned long> failed_writes{0};
+    std::atomic<unsigned long> commits{0};
+    std::atomic<unsigned long> async_commits{0};
+
+public:
+    explicit WriteCoordinator(const std::string& conn_string)
+        : connection_string(conn_string) {
+        writer = std::thread([this] { writerLoop(); });
+    }
+
+    ~WriteCoordinator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        arrived.notify_all();
+        writer.join();
+    }
+
+    std::future<pqxx::result> submit(Operation op, Durability durability = Durability::Sync) {
+        auto request = std::make_unique<Request>();
+        request->op = std::move(op);
+        request->durability = durability;
+        std::future<pqxx::result> result = request->result.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(request));
+        }
+        arrived.notify_one();
+        return result;
+    }
+
+    // Ждет фиксации группы и возвращает результат своей записи или ее ошибку
+    pqxx::result execute(Operation op, Durability durability = Durability::Sync) {
+        return submit(std::move(op), durability).get();
+    }
+
+    // pid серверного процесса, через который идут записи (0 до подключения)
+    const std::atomic<int>& backendPid() const { return backend_pid; }
+
+    unsigned long writeCount() const { return writes; }
+    unsigned long failedCount() const { return failed_writes; }
+    unsigned long commitCount() const { return commits; }
+    unsigned long asyncCommitCount() const { return async_commits; }
+
+private:
+    void writerLoop() {
+        std::unique_ptr<pqxx::connection> conn;
+        while (true) {
+            std::vector<std::unique_ptr<Request>> group;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                arrived.wait(lock, [this] { return !pending.empty() || stopping; });
+                if (pending.empty()) {
+                    return;
+                }
+                // Окно группировки отсчитывается от первой записи группы
+                auto deadline = std::chrono::steady_clock::now() + GROUP_WINDOW;
+                arrived.wait_until(lock, deadline, [this] {
+                    return pending.size() >= MAX_GROUP || stopping;
+                });
+                while (!pending.empty() && group.size() < MAX_GROUP) {
+                    group.push_back(std::move(pending.front()));
+                    pending.pop_front();
+                }
+            }
+
+            std::vector<Request*> sync_group, async_group;
+            for (auto& request : group) {
+                (request->durability == Durability::Async ? async_group : sync_group).push_back(request.get());
+            }
+            try {
+                if (!conn || !conn->is_open()) {
+                    conn = std::make_unique<pqxx::connection>(connection_string);
+                    prepareStatements(*conn);
+                    backend_pid = conn->backendpid();
+                }
+            } catch (...) {
+                for (auto& request : group) {
+                    request->result.set_exception(std::current_exception());
+                }
+                failed_writes += group.size();
+                conn.reset();
+                continue;
+            }
+            commitGroup(*conn, sync_group, false);
+            commitGroup(*conn, async_group, true);
+        }
+    }
+
+    void commitGroup(pqxx::connection& conn, const std::vector<Request*>& group, bool async) {
+        if (group.empty()) {
+            return;
+        }
+        std::vector<pqxx::result> results(group.size());
+        std::vector<std::exception_ptr> errors(group.size());
+        try {
+            pqxx::work txn(conn);
+            if (async) {
+                txn.exec("SET LOCAL synchronous_commit = off");
+            }
+            for (size_t i = 0; i < group.size(); i++) {
+                try {
+                    pqxx::subtransaction sub(txn);
+                    results[i] = group[i]->op(sub);
+                    sub.commit();
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+            txn.commit();
+        } catch (...) {
+            // Не удалась сама фиксация: ошибка у всех записей группы
+            for (auto* request : group) {
+                request->result.set_exception(std::current_exception());
+            }
+            failed_writes += group.size();
+            return;
+        }
+
+        commits++;
+        if (async) {
+            async_commits++;
+        }
+        for (size_t i = 0; i < group.size(); i++) {
+            if (errors[i]) {
+                group[i]->result.set_exception(errors[i]);
+                failed_writes++;
+            } else {
+                group[i]->result.set_value(results[i]);
+                writes++;
+            }
+        }
+    }
+};
+
+// Публичные методы CinemaDatabase, которые пишутся в журнал нагрузки.
+// Значения хранятся в файле, поэтому существующие номера не меняются.
+enum class CallMethod : uint8_t {
+    ShowTestData = 1,
+    FindFilmsByYear = 2,
+    GetDirectorStatistics = 3,
+    FindActorsByFilm = 4,
+    GetTopGrossingFilms = 5,
+    AddActor = 6,
+    FindFilmsByGenre = 7,
+    GetAverageFilmRatings = 8,
+    AddFilm = 9,
+    UpdateFilmBoxOffice = 10,
+    DemonstrateAllQueries = 11,
+    FilmDurationStatistics = 12,
+    AddReview = 13,
+    SearchReviews = 14,
+    SearchFilms = 15
+};
+
+static const char* callMethodName(CallMethod method) {
+    switch (method) {
+        case CallMethod::ShowTestData: return "showTestData";
+        case CallMethod::FindFilmsByYear: return "findFilmsByYear";
+        case CallMethod::GetDirectorStatistics: return "getDirectorStatistics";
+        case CallMethod::FindActorsByFilm: return "findActorsByFilm";
+        case CallMethod::GetTopGrossingFilms: return "getTopGrossingFilms";
+        case CallMethod::AddActor: return "addActor";
+        case CallMethod::FindFilmsByGenre: return "findFilmsByGenre";
+        case CallMethod::GetAverageFilmRatings: return "getAverageFilmRatings";
+        case CallMethod::AddFilm: return "addFilm";
+        case CallMethod::UpdateFilmBoxOffice: return "updateFilmBoxOffice";
+        case CallMethod::DemonstrateAllQueries: return "demonstrateAllQueries";
+        case CallMethod::FilmDurationStatistics: return "filmDurationStatistics";
+        case CallMethod::AddReview: return "addReview";
+        case CallMethod::SearchReviews: return "searchReviews";
+        case CallMethod::SearchFilms: return "searchFilms";
+    }
+    return "unknown";
+}
+
+static bool callMethodByName(const std::string& name, CallMethod& method) {
+    for (int i = 1; i <= static_cast<int>(CallMethod::SearchFilms); i++) {
+        if (name == callMethodName(static_cast<CallMethod>(i))) {
+            method = static_cast<CallMethod>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Аргумент записанного вызова
+struct CallArg {
+    enum Type : uint8_t { Int = 0, Double = 1, String = 2, Bool = 3 };
+
+    Type type = Int;
+    int64_t int_value = 0;
+    double double_value = 0;
+    std::string string_value;
+
+    CallArg() = default;
+    CallArg(int value) : type(Int), int_value(value) {}
+    CallArg(double value) : type(Double), double_value(value) {}
+    CallArg(bool value) : type(Bool), int_value(value ? 1 : 0) {}
+    CallArg(const std::string& value) : type(String), string_value(value) {}
+};
+
+struct RecordedCall {
+    CallMethod method;
+    uint64_t timestamp_us;  // от начала записи
+    uint32_t latency_us;
+    std::vector<CallArg> args;
+};
+
+// Журнал вызовов в компактном двоичном формате:
+// заголовок "CINREC1\0", затем записи
+// [метод u8][время u64][задержка u32][число аргументов u8][аргументы],
+// аргумент - [тип u8] и значение (int64, double или строка u32 + байты).
+class WorkloadRecorder {
+private:
+    std::ofstream out;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point last_flush;
+    unsigned long recorded = 0;
+
+    // Журнал сбрасывается на диск не реже раза в секунду, чтобы при падении
+    // процесса терялись только последние записи
+    static constexpr auto FLUSH_INTERVAL = std::chrono::seconds(1);
+    static constexpr unsigned long FLUSH_RECORDS = 256;
+
+    template<typename T>
+    void writeValue(T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+public:
+    static constexpr char MAGIC[8] = {'C', 'I', 'N', 'R', 'E', 'C', '1', '\0'};
+
+    explicit WorkloadRecorder(const std::string& path)
+        : out(path, std::ios::binary | std::ios::trunc), started(std::chrono::steady_clock::now()),
+          last_flush(started) {
+        if (!out) {
+            throw std::runtime_error("Failed to open workload log " + path);
+        }
+        out.write(MAGIC, sizeof(MAGIC));
+    }
+
+    ~WorkloadRecorder() {
+        out.flush();
+    }
+
+    void record(CallMethod method, const std::vector<CallArg>& args,
+                std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::microseconds>(start - started).count();
+        uint32_t latency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        writeValue<uint8_t>(static_cast<uint8_t>(method));
+        writeValue<uint64_t>(timestamp);
+        writeValue<uint32_t>(latency);
+        writeValue<uint8_t>(args.size());
+        for (const auto& arg : args) {
+            writeValue<uint8_t>(arg.type);
+            if (arg.type == CallArg::Double) {
+                writeValue<double>(arg.double_value);
+            } else if (arg.type == CallArg::String) {
+                writeValue<uint32_t>(arg.string_value.size());
+                out.write(arg.string_value.data(), arg.string_value.size());
+            } else {
+                writeValue<int64_t>(arg.int_value);
+            }
+        }
+        recorded++;
+        if (recorded % FLUSH_RECORDS == 0 || end - last_flush >= FLUSH_INTERVAL) {
+            out.flush();
+            last_flush = end;
+        }
+    }
+
+    unsigned long recordedCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recorded;
+    }
+
+    static std::vector<RecordedCall> load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("Not a workload log: " + path);
+        }
+        auto read = [&in](auto& value) {
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+        };
+        auto readCall = [&](RecordedCall& call) {
+            uint8_t arg_count;
+            if (!read(call.timestamp_us) || !read(call.latency_us) || !read(arg_count)) {
+                return false;
+            }
+            call.args.resize(arg_count);
+            for (auto& arg : call.args) {
+                uint8_t type;
+                if (!read(type)) {
+                    return false;
+                }
+                arg.type = static_cast<CallArg::Type>(type);
+                if (arg.type == CallArg::Double) {
+                    if (!read(arg.double_value)) {
+                        return false;
+                    }
+                } else if (arg.type == CallArg::String) {
+                    uint32_t length;
+                    if (!read(length)) {
+                        return false;
+                    }
+                    arg.string_value.resize(length);
+                    if (length > 0 && !in.read(&arg.string_value[0], length)) {
+                        return false;
+                    }
+                } else if (!read(arg.int_value)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::vector<RecordedCall> calls;
+        uint8_t method;
+        while (in.read(reinterpret_cast<char*>(&method), sizeof(method))) {
+            RecordedCall call;
+            call.method = static_cast<CallMethod>(method);
+            // Недописанная последняя запись - след падения во время записи:
+            // журнал до нее остается пригодным
+            if (!readCall(call)) {
+                std::cerr << "Ignoring truncated record at the end of workload log after "
+                          << calls.size() << " calls" << std::endl;
+                break;
+            }
+            calls.push_back(std::move(call));
+        }
+        return calls;
+    }
+};
+
+// Записывает вызов метода в журнал при выходе из него
+class CallRecord {
+private:
+    WorkloadRecorder* recorder;
+    CallMethod method;
+    std::vector<CallArg> args;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    CallRecord(WorkloadRecorder* workload_recorder, CallMethod called, std::vector<CallArg> call_args = {})
+        : recorder(workload_recorder), method(called), args(std::move(call_args)),
+          start(std::chrono::steady_clock::now()) {}
+
+    ~CallRecord() {
+        if (recorder) {
+            recorder->record(method, args, start, std::chrono::steady_clock::now());
+        }
+    }
+};
+
+// Бюджет памяти операции исчерпан: операция прерывается, а не растит процесс
+class MemoryBudgetExceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Размер PGresult в памяти: на каждое значение libpq хранит длину и
+// указатель (PGresAttValue) и сами байты с нулевым терминатором
+constexpr size_t PG_VALUE_OVERHEAD = sizeof(int) + sizeof(char*) + 1;
+constexpr size_t PG_ROW_OVERHEAD = sizeof(void*);
+
+static size_t resultMemory(const pqxx::result& result) {
+    size_t bytes = 0;
+    for (const auto& row : result) {
+        bytes += PG_ROW_OVERHEAD;
+        for (const auto& field : row) {
+            bytes += field.size() + PG_VALUE_OVERHEAD;
+        }
+    }
+    return bytes;
+}
+
+// Результат, прочитанный курсором порциями. Перебирается как одна выборка,
+// поэтому код вывода не зависит от того, как результат был прочитан.
+class ChunkedResult {
+private:
+    std::vector<pqxx::result> chunks;
+    size_t rows = 0;
+
+public:
+    class const_iterator {
+    private:
+        const std::vector<pqxx::result>* chunks;
+        size_t chunk;
+        pqxx::result::size_type row;
+
+    public:
+        const_iterator(const std::vector<pqxx::result>* all, size_t chunk_index)
+            : chunks(all), chunk(chunk_index), row(0) {}
+
+        pqxx::row operator*() const { return (*chunks)[chunk][row]; }
+
+        const_iterator& operator++() {
+            if (++row == (*chunks)[chunk].size()) {
+                chunk++;
+                row = 0;
+            }
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return chunk != other.chunk || row != other.row;
+        }
+    };
+
+    ChunkedResult() = default;
+    ChunkedResult(pqxx::result result) { append(std::move(result)); }
+
+    // Пустые порции не хранятся, итератору не нужно их пропускать
+    void append(pqxx::result chunk) {
+        if (!chunk.empty()) {
+            rows += chunk.size();
+            chunks.push_back(std::move(chunk));
+        }
+    }
+
+    void clear() {
+        chunks.clear();
+        rows = 0;
+    }
+
+    const std::vector<pqxx::result>& parts() const { return chunks; }
+    bool empty() const { return rows == 0; }
+    size_t size() const { return rows; }
+
+    pqxx::row operator[](size_t index) const {
+        for (const auto& chunk : chunks) {
+            if (index < chunk.size()) {
+                return chunk[index];
+            }
+            index -= chunk.size();
+        }
+        throw std::out_of_range("row index out of range");
+    }
+
+    const_iterator begin() const { return const_iterator(&chunks, 0); }
+    const_iterator end() const { return const_iterator(&chunks, chunks.size()); }
+};
+
+static std::string mebibytes(size_t bytes) {
+    return fixedDecimal(bytes / (1024.0 * 1024.0), 1) + " MiB";
+}
+
+// Память по операциям (публичным методам CinemaDatabase) за все время:
+// пик удерживаемых результатов, объем декодированных строк, кэши.
+// Бюджет задается общий и при необходимости отдельно для метода.
+class MemoryLedger {
+public:
+    struct Stats {
+        unsigned long calls = 0;
+        size_t peak_result_bytes = 0;
+        size_t decoded_bytes = 0;
+        size_t cache_bytes = 0;
+        unsigned long streamed = 0;  // вызовы, читавшие результат курсором
+        unsigned long rejected = 0;  // вызовы, прерванные по бюджету
+    };
+
+private:
+    size_t default_budget;
+    std::map<CallMethod, size_t> budgets;
+    std::map<CallMethod, Stats> stats;
+    std::mutex mutex;
+
+public:
+    static constexpr size_t DEFAULT_BUDGET_BYTES = 256 * 1024 * 1024;
+
+    MemoryLedger() : default_budget(DEFAULT_BUDGET_BYTES) {}
+
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        default_budget = bytes;
+    }
+
+    void setBudget(CallMethod method, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budgets[method] = bytes;
+    }
+
+    size_t budget(CallMethod method) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = budgets.find(method);
+        return it != budgets.end() ? it->second : default_budget;
+    }
+
+    void publish(CallMethod method, const Stats& call) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats& total = stats[method];
+        total.calls += call.calls;
+        total.peak_result_bytes = std::max(total.peak_result_bytes, call.peak_result_bytes);
+        total.decoded_bytes += call.decoded_bytes;
+        total.cache_bytes = std::max(total.cache_bytes, call.cache_bytes);
+        total.streamed += call.streamed;
+        total.rejected += call.rejected;
+    }
+
+    std::map<CallMethod, Stats> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+};
+
+// Учет памяти одного вызова. Результаты учитываются, пока удерживаются
+// (hold/release); разделы отчетов читаются параллельно, поэтому счетчики
+// атомарные. При разрушении итоги вызова уходят в MemoryLedger.
+class MemoryAccount {
+private:
+    MemoryLedger& ledger;
+    CallMethod method;
+    size_t limit;
+    std::atomic<size_t> held{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<size_t> decoded{0};
+    std::atomic<size_t> cache{0};
+    std::atomic<bool> streamed{false};
+    std::atomic<bool> rejected{false};
+
+public:
+    MemoryAccount(MemoryLedger& memory_ledger, CallMethod called)
+        : ledger(memory_ledger), method(called), limit(memory_ledger.budget(called)) {}
+
+    ~MemoryAccount() {
+        MemoryLedger::Stats call;
+        call.calls = 1;
+        call.peak_result_bytes = peak;
+        call.decoded_bytes = decoded;
+        call.cache_bytes = cache;
+        call.streamed = streamed ? 1 : 0;
+        call.rejected = rejected ? 1 : 0;
+        ledger.publish(method, call);
+    }
+
+    size_t budget() const { return limit; }
+
+    bool fits(size_t bytes) const { return held + bytes <= limit; }
+
+    // Учитывает результат, если он помещается в бюджет
+    bool tryHold(size_t bytes) {
+        size_t now = held += bytes;
+        if (now > limit) {
+            held -= bytes;
+            return false;
+        }
+        size_t previous = peak;
+        while (now > previous && !peak.compare_exchange_weak(previous, now)) {
+        }
+        return true;
+    }
+
+    void hold(size_t bytes, const std::string& statement) {
+        if (!tryHold(bytes)) {
+            reject(bytes, statement);
+        }
+    }
+
+    void release(size_t bytes) { held -= bytes; }
+
+    [[noreturn]] void reject(size_t bytes, const std::string& statement) {
+        rejected = true;
+        throw MemoryBudgetExceeded("memory budget exceeded: " + statement + " needs " + mebibytes(bytes) +
+                                   ", " + callMethodName(method) + " has " + mebibytes(limit - std::min(limit, held.load())) +
+                                   " of " + mebibytes(limit) + " left");
+    }
+
+    void addDecoded(size_t bytes) { decoded += bytes; }
+    void setCache(size_t bytes) { cache = bytes; }
+    void markStreamed() { streamed = true; }
+};
+
+// Раздел отчета: запрос из реестра и этапы форматирования его результата.
+// Этапы одного раздела выполняются параллельно, вывод идет по порядку.
+struct ReportSection {
+    std::string statement;
+    std::vector<std::function<void(const ChunkedResult&, std::ostream&)>> stages;
+    // Вывод порциями, если результат не помещается в бюджет памяти:
+    // вызывается для каждой порции с числом уже выведенных строк, последняя
+    // порция пустая. Раздел без него в таком случае завершается ошибкой.
+    std::function<void(const pqxx::result&, size_t, std::ostream&)> stream;
+};
 
 class CinemaDatabase {
 private:
-    pqxx::connection* conn;
+    std::string connection_string;
+    pqxx::connection* conn = nullptr;
+    // Готовность основного соединения и схемы; при быстром старте
+    // подключение идет в фоне, и запросы к базе ждут этот future
+    std::shared_future<void> connected;
+    // Фоновое заполнение search_vector и построение GIN-индексов
+    std::future<void> search_indexes;
+    std::atomic<bool> shutting_down{false};
+    ConnectionPool pool;
+    TaskScheduler scheduler;
+    SingleFlight single_flight;
+    WriteCoordinator writes;
+    TopGrossingLeaderboard leaderboard{100};
+    std::unique_ptr<pqxx::connection> listen_conn;
+    std::unique_ptr<ChangeListener> film_listener;
+    std::unique_ptr<ChangeListener> review_listener;
+    // Поток, который принимает уведомления на listen_conn
+    std::thread listen_thread;
+    std::atomic<unsigned long> leaderboard_reads{0};
+    std::atomic<unsigned long> leaderboard_seeds{0};
+    std::atomic<unsigned long> film_notifications{0};
+    std::atomic<unsigned long> review_notifications{0};
+    std::atomic<int> review_writer_pid{0};
+    RatingAggregates film_ratings;
+    std::mutex film_ratings_mutex;
+    std::unique_ptr<ReviewIngestionPipeline> review_ingestion;
+    std::mutex review_ingestion_mutex;
+    std::string snapshot_fingerprint;
+    TaskScheduler::TaskPtr warm_up;
+    
+    static constexpr const char* CATALOG_SNAPSHOT_PATH = "catalog.snapshot";
+    std::unique_ptr<WorkloadRecorder> recorder;
+    MemoryLedger memory;
+    
+    std::atomic<bool> rethrow_errors{false};
+    
+    // Строк в одной порции при чтении курсором
+    static constexpr size_t STREAM_CHUNK_ROWS = 1000;
+    // Сколько поток уведомлений ждет их, прежде чем проверить завершение
+    static constexpr long LISTEN_WAIT_US = 200000;
+    
+    // Курсор неограниченного запроса. Соединение из пула и транзакция
+    // держатся, пока курсор не уничтожен.
+    class ResultCursor {
+    private:
+        ConnectionPool::Lease lease;
+        pqxx::read_transaction txn;
+        std::string fetch_sql;
+
+    public:
+        template<typename... Args>
+        ResultCursor(ConnectionPool::Lease connection, const StatementDef& stmt, const std::string& snapshot,
+                     const Args&... args)
+            : lease(std::move(connection)), txn(*lease),
+              fetch_sql("FETCH FORWARD " + std::to_string(STREAM_CHUNK_ROWS) + " FROM stream_cursor") {
+            useSnapshot(txn, snapshot);
+            txn.exec(CURSOR_SETTINGS);
+            txn.exec_params(declareCursor("stream_cursor", stmt.sql), args...);
+        }
+
+        pqxx::result fetch() { return txn.exec(fetch_sql); }
+
+        void detach() { lease.detach(); }
+    };
+    
+    // Неограниченный запрос, не поместившийся в бюджет: прочитанные порции
+    // (учтены в бюджете, пока overflow жив), порция, на которой бюджет
+    // кончился, и курсор с остатком результата
+    struct CursorOverflow {
+        MemoryAccount* account = nullptr;
+        size_t held = 0;
+        ChunkedResult buffered;
+        pqxx::result pending;
+        std::unique_ptr<ResultCursor> cursor;
+
+        CursorOverflow() = default;
+        CursorOverflow(const CursorOverflow&) = delete;
+        CursorOverflow& operator=(const CursorOverflow&) = delete;
+
+        ~CursorOverflow() { reset(); }
+
+        // Освобождает учтенные порции и закрывает курсор
+        void reset() {
+            if (account) {
+                account->release(held);
+            }
+            account = nullptr;
+            held = 0;
+            buffered.clear();
+            pending = pqxx::result();
+            cursor.reset();
+        }
+    };
+    
+    // Выполняет читающий запрос из реестра на соединении из пула.
+    // Одинаковые одновременные вызовы объединяются в один поход в базу.
+    template<typename... Args>
+    pqxx::result query(const std::string& statement, const Args&... args) {
+        return snapshotQuery(std::string(), statement, args...);
+    }
+    
+    // То же в снимке, экспортированном другой транзакцией (пустой - без
+    // снимка); объединяются только вызовы в одном снимке
+    template<typename... Args>
+    pqxx::result snapshotQuery(const std::string& snapshot, const std::string& statement, const Args&... args) {
+        connected.get();
+        std::string key = snapshot + '\x1f' + statement;
+        ((key += '\x1f' + pqxx::to_string(args)), ...);
+        return single_flight.run(key, [&] {
+            auto lease = pool.acquire();
+            pqxx::read_transaction txn(*lease);
+            useSnapshot(txn, snapshot);
+            return txn.exec_prepared(statement, args...);
+        });
+    }
+    
+    // Импорт снимка (pg_export_snapshot) должен идти до первого запроса
+    // транзакции и требует REPEATABLE READ: READ COMMITTED берет новый снимок
+    // на каждый запрос
+    static void useSnapshot(pqxx::transaction_base& txn, const std::string& snapshot) {
+        if (!snapshot.empty()) {
+            txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ; "
+                     "SET TRANSACTION SNAPSHOT " + txn.quote(snapshot));
+        }
+    }
     
 public:
-    CinemaDatabase(const std::string& connection_string) {
+    // Не больше 8 соединений для отчетов, чтобы не упереться в max_connections.
+    // При fast_start конструктор не ждет базу: каталог поднимается из снимка,
+    // а подключение, подготовка запросов и прогрев идут в фоновых потоках.
+    CinemaDatabase(const std::string& connection_string, bool fast_start = false)
+        : connection_string(connection_string),
+          pool(connection_string, std::min<size_t>(std::max(std::thread::hardware_concurrency(), 2u), 8)),
+          scheduler(std::max(std::thread::hardware_concurrency(), 2u)),
+          writes(connection_string) {
+        if (!fast_start) {
+            connect();
+            QueryPlanInspector(*conn, "query_plans.baseline").checkIndexUsage();
+            std::promise<void> ready;
+            ready.set_value();
+            connected = ready.get_future().share();
+            listen_thread = std::thread([this] { listenForChanges(); });
+            return;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        bool from_snapshot = loadCatalogSnapshot();
+        connected = std::async(std::launch::async, [this] { connect(); }).share();
+        listen_thread = std::thread([this] { listenForChanges(); });
+        warmUp(from_snapshot);
+        double elapsed_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "Ready in " << std::fixed << std::setprecision(2) << elapsed_ms << " ms"
+                  << (from_snapshot ? " (catalog loaded from snapshot)" : "") << std::endl;
+    }
+    
+    ~CinemaDatabase() {
+        // Фоновые задачи обращаются к полям объекта, дожидаемся их
+        if (warm_up) {
+            try {
+                scheduler.wait(warm_up);
+            } catch (const std::exception &) {
+            }
+        }
+        if (connected.valid()) {
+            connected.wait();
+        }
+        shutting_down = true;
+        if (search_indexes.valid()) {
+            search_indexes.wait();
+        }
+        if (listen_thread.joinable()) {
+            listen_thread.join();
+        }
+        review_ingestion.reset();
+        film_listener.reset();
+        review_listener.reset();
+        listen_conn.reset();
+        if (conn) {
+            conn->close();
+            delete conn;
+        }
+    }
+    
+    void connect() {
         try {
             conn = new pqxx::connection(connection_string);
             if (conn->is_open()) {
                 std::cout << "Connected to database successfully!" << std::endl;
+                SchemaMigrator(*conn).migrate();
+                search_indexes = std::async(std::launch::async, [this] { buildSearchIndexes(); });
+                prepareStatements(*conn);
+                listen_conn = std::make_unique<pqxx::connection>(connection_string);
+                film_listener = std::make_unique<ChangeListener>(*listen_conn, "films_changed", writes.backendPid());
+                review_listener = std::make_unique<ChangeListener>(*listen_conn, "reviews_changed", review_writer_pid);
             } else {
                 throw std::runtime_error("Failed to open database");
             }
@@ -24,349 +3610,743 @@ public:
         }
     }
     
-    ~CinemaDatabase() {
-        if (conn) {
-            conn->close();
-            delete conn;
+    void buildSearchIndexes() {
+        try {
+            pqxx::connection maintenance(connection_string);
+            SearchIndexBuilder(maintenance, shutting_down).build();
+        } catch (const std::exception &e) {
+            std::cerr << "Error building search indexes: " << e.what() << std::endl;
+        }
+    }
+    
+    bool isConnected() {
+        try {
+            connected.get();
+            return true;
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+    
+    // Основное соединение (проверка планов); ждет завершения подключения
+    pqxx::connection& database() {
+        connected.get();
+        return *conn;
+    }
+    
+    // Прогрев после подключения: пул соединений, кэши и проверка индексов
+    // выполняются параллельно в пуле потоков
+    void warmUp(bool from_snapshot) {
+        std::vector<TaskScheduler::TaskPtr> tasks;
+        for (size_t i = 0; i < pool.capacity(); i++) {
+            tasks.push_back(scheduler.submit([this] {
+                if (isConnected()) {
+                    pool.preopen();
+                }
+            }));
+        }
+        tasks.push_back(scheduler.submit([this, from_snapshot] {
+            if (!isConnected()) {
+                return;
+            }
+            if (from_snapshot) {
+                verifyCatalogSnapshot();
+            } else {
+                topGrossing(0);
+                seedFilmRatings();
+            }
+        }));
+        tasks.push_back(scheduler.submit([this] {
+            if (isConnected()) {
+                auto lease = pool.acquire();
+                QueryPlanInspector(*lease, "query_plans.baseline").checkIndexUsage();
+            }
+        }));
+        warm_up = scheduler.submit([] {}, tasks);
+    }
+    
+    bool loadCatalogSnapshot() {
+        CatalogSnapshot snapshot;
+        try {
+            if (!snapshot.load(CATALOG_SNAPSHOT_PATH)) {
+                return false;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Ignoring catalog snapshot: " << e.what() << std::endl;
+            return false;
+        }
+        leaderboard.restore(snapshot.leaderboard, snapshot.leaderboard_complete);
+        film_ratings.seed(snapshot.ratings);
+        snapshot_fingerprint = snapshot.fingerprint;
+        return true;
+    }
+    
+    // Сверяет снимок с базой и перечитывает каталог, если база изменилась
+    void verifyCatalogSnapshot() {
+        std::string fingerprint = catalogFingerprint();
+        if (fingerprint == snapshot_fingerprint) {
+            return;
+        }
+        reseedLeaderboard();
+        // Отзывы, уже записанные работающим конвейером, входят в перечитанные
+        // агрегаты, а следующие пачки применятся к ним как обычно
+        betweenReviewCommits([this] { seedFilmRatings(true); });
+    }
+    
+    // Снимок пишется при штатном выходе. Отпечаток берется до выгрузки,
+    // чтобы изменения между ними давали несовпадение, а не устаревший снимок.
+    // Топ и агрегаты перечитываются: в памяти они могли отстать от базы
+    // (например, после переименования режиссера).
+    void saveCatalogSnapshot() {
+        try {
+            {
+                std::lock_guard<std::mutex> lock(review_ingestion_mutex);
+                review_ingestion.reset();
+            }
+            CatalogSnapshot snapshot;
+            snapshot.fingerprint = catalogFingerprint();
+            reseedLeaderboard();
+            seedFilmRatings(true);
+            leaderboard.exportState(snapshot.leaderboard, snapshot.leaderboard_complete);
+            snapshot.ratings = film_ratings.snapshot();
+            snapshot.save(CATALOG_SNAPSHOT_PATH);
+        } catch (const std::exception &e) {
+            std::cerr << "Error saving catalog snapshot: " << e.what() << std::endl;
+        }
+    }
+    
+    // Запись через координатор групповой фиксации
+    pqxx::result write(WriteCoordinator::Operation op, Durability durability = Durability::Sync) {
+        connected.get();
+        return writes.execute(std::move(op), durability);
+    }
+    
+    static const StatementDef& statementDef(const std::string& name) {
+        for (const auto& stmt : STATEMENTS) {
+            if (name == stmt.name) {
+                return stmt;
+            }
+        }
+        throw std::logic_error("unknown statement " + name);
+    }
+    
+    // Результат под бюджетом вызова. Ограниченный запрос выполняется
+    // обычным query() и учитывается целиком. Неограниченный читается
+    // курсором (readCursor); одинаковые одновременные вызовы делят одно
+    // чтение, и общий результат учитывается в бюджете каждого из них. Если
+    // результат не поместился, возвращается false и needed - сколько уже не
+    // поместилось; у неограниченного запроса overflow получает прочитанное и
+    // открытый курсор, остаток дочитывает streamRest. Непустой snapshot -
+    // снимок, в котором идет чтение (см. snapshotQuery).
+    template<typename... Args>
+    bool fetchWithinBudget(MemoryAccount& account, const StatementDef& stmt, ChunkedResult& result,
+                           size_t& needed, CursorOverflow& overflow, const std::string& snapshot,
+                           const Args&... args) {
+        if (!stmt.unbounded) {
+            pqxx::result r = snapshotQuery(snapshot, stmt.name, args...);
+            needed = resultMemory(r);
+            if (!account.tryHold(needed)) {
+                return false;
+            }
+            account.addDecoded(stmt.decoded_bytes(r));
+            result = ChunkedResult(r);
+            return true;
+        }
+        
+        connected.get();
+        std::string key = snapshot + '\x1f' + "cursor" + '\x1f' + stmt.name;
+        ((key += '\x1f' + pqxx::to_string(args)), ...);
+        bool leader = false;
+        std::shared_ptr<const ChunkedResult> shared = single_flight.run(key, [&] {
+            leader = true;
+            return readCursor(account, stmt, overflow, needed, snapshot, args...);
+        });
+        if (!leader && shared) {
+            size_t bytes = 0;
+            size_t decoded = 0;
+            for (const auto& chunk : shared->parts()) {
+                bytes += resultMemory(chunk);
+                decoded += stmt.decoded_bytes(chunk);
+            }
+            if (account.tryHold(bytes)) {
+                account.addDecoded(decoded);
+                result = *shared;
+                return true;
+            }
+        }
+        // Не поместилось в бюджет вызова, который читал курсор, или в свой:
+        // у каждого вызова бюджет свой, поэтому читаем отдельно
+        if (!leader) {
+            shared = readCursor(account, stmt, overflow, needed, snapshot, args...);
+        }
+        if (!shared) {
+            return false;
+        }
+        result = *shared;
+        return true;
+    }
+    
+    // Читает курсор порциями, пока они помещаются в бюджет, поэтому больше
+    // бюджета в памяти не бывает. Возвращает весь результат или nullptr,
+    // если очередная порция не поместилась; тогда прочитанное и курсор
+    // остаются в overflow.
+    template<typename... Args>
+    std::shared_ptr<const ChunkedResult> readCursor(MemoryAccount& account, const StatementDef& stmt,
+                                                    CursorOverflow& overflow, size_t& needed,
+                                                    const std::string& snapshot, const Args&... args) {
+        auto cursor = std::make_unique<ResultCursor>(pool.acquire(), stmt, snapshot, args...);
+        auto result = std::make_shared<ChunkedResult>();
+        size_t held = 0;
+        while (true) {
+            pqxx::result chunk = cursor->fetch();
+            size_t bytes = resultMemory(chunk);
+            if (!account.tryHold(bytes)) {
+                needed = held + bytes;
+                overflow.account = &account;
+                overflow.held = held;
+                overflow.buffered = std::move(*result);
+                overflow.pending = chunk;
+                overflow.cursor = std::move(cursor);
+                return nullptr;
+            }
+            held += bytes;
+            account.addDecoded(stmt.decoded_bytes(chunk));
+            // Неполная порция - курсор дочитан
+            bool last = chunk.size() < STREAM_CHUNK_ROWS;
+            result->append(chunk);
+            if (last) {
+                return result;
+            }
+        }
+    }
+    
+    // Отдает потребителю не поместившийся результат порциями, в памяти
+    // одновременно одна порция; последняя порция всегда пустая
+    template<typename Consumer>
+    void streamRest(const StatementDef& stmt, CursorOverflow& overflow, Consumer&& consume) {
+        MemoryAccount& account = *overflow.account;
+        account.markStreamed();
+        for (const auto& buffered : overflow.buffered.parts()) {
+            consume(buffered);
+        }
+        account.release(overflow.held);
+        overflow.held = 0;
+        overflow.buffered.clear();
+        pqxx::result chunk = overflow.pending;
+        while (true) {
+            size_t bytes = resultMemory(chunk);
+            account.hold(bytes, stmt.name);
+            account.addDecoded(stmt.decoded_bytes(chunk));
+            consume(chunk);
+            account.release(bytes);
+            if (chunk.empty()) {
+                break;
+            }
+            chunk = overflow.cursor->fetch();
+        }
+        overflow.cursor.reset();
+    }
+    
+    // Результат целиком или MemoryBudgetExceeded
+    template<typename... Args>
+    ChunkedResult fetchAll(MemoryAccount& account, const std::string& statement, const Args&... args) {
+        ChunkedResult result;
+        size_t needed = 0;
+        CursorOverflow overflow;
+        if (!fetchWithinBudget(account, statementDef(statement), result, needed, overflow, std::string(), args...)) {
+            account.reject(needed, statement);
+        }
+        return result;
+    }
+    
+    // Читающий запрос под бюджетом вызова: результат приходит потребителю
+    // порциями (последняя пустая); если он не помещается в бюджет, чтение
+    // продолжается тем же курсором без повторного выполнения запроса
+    template<typename Consumer, typename... Args>
+    void fetchOrStream(MemoryAccount& account, const std::string& statement, Consumer&& consume,
+                       const Args&... args) {
+        const StatementDef& stmt = statementDef(statement);
+        ChunkedResult result;
+        size_t needed = 0;
+        CursorOverflow overflow;
+        if (!fetchWithinBudget(account, stmt, result, needed, overflow, std::string(), args...)) {
+            if (!overflow.cursor) {
+                account.reject(needed, statement);
+            }
+            streamRest(stmt, overflow, consume);
+            return;
+        }
+        for (const auto& chunk : result.parts()) {
+            consume(chunk);
+        }
+        consume(pqxx::result());
+    }
+    
+    static std::string intArray(const std::vector<int>& values) {
+        std::string array = "{";
+        for (size_t i = 0; i < values.size(); i++) {
+            array += (i ? "," : "") + std::to_string(values[i]);
+        }
+        return array + "}";
+    }
+    
+    std::string catalogFingerprint() {
+        using Fingerprint = Table<CatalogFingerprintQuery>;
+        Fingerprint::Row row = Fingerprint::decode(query(CatalogFingerprintQuery::name)[0]);
+        return std::get<Fingerprint::index("fingerprint")>(row);
+    }
+    
+    static TopGrossingLeaderboard::Entry leaderboardEntry(const pqxx::row& result_row) {
+        using Films = Table<LeaderboardSeedQuery>;
+        Films::Row row = Films::decode(result_row);
+        return {std::get<Films::index("film_id")>(row), std::get<Films::index("title")>(row),
+                std::get<Films::index("release_year")>(row), std::get<Films::index("box_office")>(row),
+                std::get<Films::index("budget")>(row), std::get<Films::index("director")>(row)};
+    }
+    
+    // Перечитывает указанные фильмы и обновляет топ; фильмы, которых
+    // больше нет в выборке, из топа убираются
+    void refreshLeaderboardFilms(const std::vector<int>& film_ids) {
+        if (!leaderboard.isSeeded()) {
+            return;
+        }
+        std::set<int> missing(film_ids.begin(), film_ids.end());
+        for (const auto& row : query(LeaderboardFilmsQuery::name, intArray(film_ids))) {
+            TopGrossingLeaderboard::Entry entry = leaderboardEntry(row);
+            missing.erase(entry.film_id);
+            leaderboard.upsert(entry);
+        }
+        for (int film_id : missing) {
+            leaderboard.remove(film_id);
+        }
+    }
+    
+    // Принимает уведомления об изменениях, сделанных другими клиентами, и
+    // сразу применяет их к топу и агрегатам рейтингов. Работает в своем
+    // потоке (listen_thread), поэтому соединение LISTEN не копит уведомления
+    // между чтениями, и только этот поток к нему обращается.
+    void listenForChanges() {
+        if (!isConnected()) {
+            return;
+        }
+        while (!shutting_down) {
+            try {
+                listen_conn->await_notification(0, LISTEN_WAIT_US);
+                std::vector<int> films;
+                std::vector<int> reviews;
+                films.swap(film_listener->changed);
+                reviews.swap(review_listener->changed);
+                if (!films.empty()) {
+                    film_notifications += films.size();
+                    refreshLeaderboardFilms(films);
+                }
+                // В том числе отзывы, удаленные каскадом вместе с фильмом
+                if (!reviews.empty()) {
+                    review_notifications += reviews.size();
+                    refreshFilmRatings(reviews);
+                }
+            } catch (const pqxx::broken_connection &e) {
+                std::cerr << "Error listening for changes: " << e.what() << std::endl;
+                return;
+            } catch (const std::exception &e) {
+                std::cerr << "Error applying changes: " << e.what() << std::endl;
+            }
+        }
+    }
+    
+    void reseedLeaderboard() {
+        std::vector<TopGrossingLeaderboard::Entry> rows;
+        for (const auto& row : query(LeaderboardSeedQuery::name, static_cast<int>(leaderboard.seedLimit()))) {
+            rows.push_back(leaderboardEntry(row));
+        }
+        leaderboard.seed(rows);
+        leaderboard_seeds++;
+    }
+    
+    // Топ-k из памяти; при первом обращении (или если топ поредел) читается из базы
+    std::vector<TopGrossingLeaderboard::Entry> topGrossing(size_t k) {
+        if (leaderboard.needsSeed()) {
+            reseedLeaderboard();
+        }
+        leaderboard_reads++;
+        return leaderboard.top(k);
+    }
+    
+    void printTopGrossingFromDatabase(MemoryAccount& account, int limit) {
+        std::cout << "\n=== Top " << limit << " Grossing Films ===" << std::endl;
+        TablePrinter<TopGrossingQuery> films(std::cout);
+        fetchOrStream(account, TopGrossingQuery::name, films, limit);
+        if (films.rowCount() == 0) {
+            std::cout << "No films found." << std::endl;
+        }
+    }
+    
+    // Агрегаты рейтингов читаются из базы один раз, до запуска конвейера
+    // отзывов; force перечитывает их, если снимок каталога устарел.
+    // С account чтение идет под бюджетом вызова, в фоне - без него.
+    void seedFilmRatings(bool force = false, MemoryAccount* account = nullptr) {
+        std::lock_guard<std::mutex> lock(film_ratings_mutex);
+        if (film_ratings.isSeeded() && !force) {
+            return;
+        }
+        ChunkedResult r = account ? fetchAll(*account, RatingAggregatesQuery::name)
+                                  : ChunkedResult(query(RatingAggregatesQuery::name));
+        film_ratings.seed(decodeFilmRatings(r));
+    }
+    
+    template<typename Result>
+    static std::map<int, RatingAggregates::FilmRating> decodeFilmRatings(const Result& r) {
+        using Aggregates = Table<RatingAggregatesQuery>;
+        std::map<int, RatingAggregates::FilmRating> rows;
+        for (const auto& result_row : r) {
+            Aggregates::Row row = Aggregates::decode(result_row);
+            RatingAggregates::FilmRating& film = rows[std::get<Aggregates::index("film_id")>(row)];
+            film.title = std::get<Aggregates::index("title")>(row);
+            film.count = std::get<Aggregates::index("review_count")>(row);
+            film.sum = std::get<Aggregates::index("rating_sum")>(row);
+            film.min = std::get<Aggregates::index("min_rating")>(row);
+            film.max = std::get<Aggregates::index("max_rating")>(row);
+        }
+        return rows;
+    }
+    
+    // Перечитывает агрегаты указанных фильмов. При работающем конвейере
+    // чтение идет между его фиксациями, чтобы дельты не учлись дважды.
+    void refreshFilmRatings(std::vector<int> film_ids) {
+        std::sort(film_ids.begin(), film_ids.end());
+        film_ids.erase(std::unique(film_ids.begin(), film_ids.end()), film_ids.end());
+        betweenReviewCommits([&] {
+            std::lock_guard<std::mutex> lock(film_ratings_mutex);
+            if (film_ratings.isSeeded()) {
+                film_ratings.replace(film_ids, decodeFilmRatings(
+                    query(FilmRatingAggregatesQuery::name, intArray(film_ids))));
+            }
+        });
+    }
+    
+    // Выполняет fn между фиксациями конвейера отзывов (если он запущен):
+    // все зафиксированные им отзывы к этому моменту уже учтены в агрегатах,
+    // и перечитанные из базы значения их не задваивают и не теряют
+    template<typename Fn>
+    void betweenReviewCommits(Fn fn) {
+        std::lock_guard<std::mutex> lock(review_ingestion_mutex);
+        if (review_ingestion) {
+            review_ingestion->quiesce(fn);
+        } else {
+            fn();
+        }
+    }
+    
+    ReviewIngestionPipeline& reviewIngestion() {
+        std::lock_guard<std::mutex> lock(review_ingestion_mutex);
+        if (!review_ingestion) {
+            seedFilmRatings();
+            review_ingestion = std::make_unique<ReviewIngestionPipeline>(connection_string, film_ratings,
+                                                                         review_writer_pid);
+        }
+        return *review_ingestion;
+    }
+    
+    // Вызывается из catch: печатает ошибку вызова или пробрасывает ее дальше
+    void reportError(const std::string& context, const std::exception& e) {
+        if (rethrow_errors) {
+            throw;
+        }
+        std::cerr << context << ": " << e.what() << std::endl;
+    }
+    
+    // Запускает разделы отчета в пуле потоков: запросы всех разделов
+    // выполняются сразу, форматирование раздела начинается, как только
+    // пришел его результат, а печать идет строго по порядку разделов.
+    // Раздел, результат которого не помещается в бюджет памяти, при наличии
+    // stream дочитывается тем же курсором в задаче печати.
+    void runReport(MemoryAccount& account, const std::vector<ReportSection>& sections,
+                   const std::string& error_context) {
+        // Разделы читаются в своих транзакциях, но в одном снимке, который
+        // экспортирует эта транзакция; она открыта, пока отчет не прочитан.
+        // Ее соединение, как и курсоры разделов, не занимает место в пуле.
+        std::unique_ptr<ConnectionPool::Lease> snapshot_lease;
+        std::unique_ptr<pqxx::read_transaction> snapshot_txn;
+        std::string snapshot;
+        try {
+            connected.get();
+            snapshot_lease = std::make_unique<ConnectionPool::Lease>(pool.acquire());
+            snapshot_lease->detach();
+            snapshot_txn = std::make_unique<pqxx::read_transaction>(**snapshot_lease);
+            snapshot = snapshot_txn->exec("SELECT pg_export_snapshot()")[0][0].as<std::string>();
+        } catch (const std::exception &e) {
+            reportError(error_context, e);
+            return;
+        }
+
+        struct SectionState {
+            ChunkedResult result;
+            CursorOverflow overflow;
+            bool streamed = false;
+            std::exception_ptr error;
+            std::vector<std::string> output;
+            std::vector<std::exception_ptr> stage_errors;
+        };
+        std::vector<std::shared_ptr<SectionState>> states;
+        // Первая ошибка отчета; разделы после нее не печатаются
+        auto failure = std::make_shared<std::exception_ptr>();
+        TaskScheduler::TaskPtr previous_print;
+
+        for (const auto& section : sections) {
+            auto state = std::make_shared<SectionState>();
+            state->output.resize(section.stages.size());
+            state->stage_errors.resize(section.stages.size());
+            states.push_back(state);
+
+            std::string statement = section.statement;
+            auto stream = section.stream;
+            TaskScheduler::TaskPtr fetch = scheduler.submit([this, &account, state, statement, stream, snapshot] {
+                try {
+                    // Здесь порции нельзя сразу выводить: разделы печатаются по
+                    // порядку. Курсор не поместившегося раздела ждет печати, его
+                    // соединение не должно задерживать запросы других разделов.
+                    size_t needed = 0;
+                    if (!fetchWithinBudget(account, statementDef(statement), state->result, needed,
+                                           state->overflow, snapshot)) {
+                        if (!stream || !state->overflow.cursor) {
+                            account.reject(needed, statement);
+                        }
+                        state->overflow.cursor->detach();
+                        state->streamed = true;
+                    }
+                } catch (...) {
+                    state->error = std::current_exception();
+                }
+            });
+
+            std::vector<TaskScheduler::TaskPtr> renders;
+            for (size_t i = 0; i < section.stages.size(); i++) {
+                auto stage = section.stages[i];
+                renders.push_back(scheduler.submit([state, stage, i] {
+                    if (state->error || state->streamed) {
+                        return;
+                    }
+                    try {
+                        std::ostringstream out;
+                        stage(state->result, out);
+                        state->output[i] = out.str();
+                    } catch (...) {
+                        state->stage_errors[i] = std::current_exception();
+                    }
+                }, {fetch}));
+            }
+            if (previous_print) {
+                renders.push_back(previous_print);
+            }
+
+            previous_print = scheduler.submit([this, &account, state, failure, statement, stream] {
+                if (*failure) {
+                    return;
+                }
+                std::exception_ptr error = state->error;
+                if (!error && state->streamed) {
+                    try {
+                        size_t rows = 0;
+                        streamRest(statementDef(statement), state->overflow, [&](const pqxx::result& chunk) {
+                            stream(chunk, rows, std::cout);
+                            rows += chunk.size();
+                        });
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                for (size_t i = 0; i < state->output.size() && !error; i++) {
+                    if (state->stage_errors[i]) {
+                        error = state->stage_errors[i];
+                        break;
+                    }
+                    std::cout << state->output[i];
+                }
+                *failure = error;
+            }, renders);
+        }
+
+        if (previous_print) {
+            scheduler.wait(previous_print);
         }
+        // Курсоры разделов, которые не печатались после ошибки
+        for (const auto& state : states) {
+            state->overflow.reset();
+        }
+        std::cout.flush();
+        if (*failure) {
+            try {
+                std::rethrow_exception(*failure);
+            } catch (const std::exception &e) {
+                reportError(error_context, e);
+            }
+        }
+    }
+    
+    // Раздел отчета: заголовок и таблица по описанию запроса. Большая
+    // таблица выводится порциями тем же кодом.
+    template<typename Query>
+    static ReportSection tableSection(const std::string& title, const std::string& empty_message = "") {
+        auto print = [title, empty_message](const pqxx::result& r, size_t rows_before, std::ostream& out) {
+            if (rows_before == 0) {
+                out << title << std::endl;
+                Table<Query>::header(out);
+            }
+            if (r.empty()) {
+                if (rows_before == 0 && !empty_message.empty()) {
+                    out << empty_message << std::endl;
+                }
+                out << std::endl;
+                return;
+            }
+            for (const auto& row : r) {
+                Table<Query>::render(out, Table<Query>::decode(row));
+            }
+        };
+        return {Query::name, {[print](const ChunkedResult& r, std::ostream& out) {
+            size_t rows = 0;
+            for (const auto& chunk : r.parts()) {
+                print(chunk, rows, out);
+                rows += chunk.size();
+            }
+            print(pqxx::result(), rows, out);
+        }}, print};
+    }
+    
+    // Включает запись всех вызовов публичных методов в журнал нагрузки
+    void startRecording(const std::string& path) {
+        recorder = std::make_unique<WorkloadRecorder>(path);
+        std::cout << "Recording workload to " << path << std::endl;
+    }
+    
+    // Бюджет памяти на вызов: общий или для отдельного метода
+    void setMemoryBudget(size_t bytes) {
+        memory.setBudget(bytes);
+    }
+    
+    void setMemoryBudget(CallMethod method, size_t bytes) {
+        memory.setBudget(method, bytes);
+    }
+    
+    // При воспроизведении журнала ошибки вызовов пробрасываются наружу,
+    // а не только печатаются, чтобы WorkloadReplayer их посчитал
+    void setRethrowErrors(bool enabled) {
+        rethrow_errors = enabled;
     }
     
     // 1. Показать тестовые данные
     void showTestData() {
-        try {
-            pqxx::work txn(*conn);
-            
-            std::cout << "\n=== Test Data Overview ===\n" << std::endl;
-            
+        CallRecord call(recorder.get(), CallMethod::ShowTestData);
+        MemoryAccount account(memory, CallMethod::ShowTestData);
+        std::vector<ReportSection> sections = {
             // 1. Режиссеры
-            std::cout << "1. Directors (режиссеры):" << std::endl;
-            pqxx::result directors = txn.exec("SELECT director_id, first_name, last_name, nationality FROM directors ORDER BY director_id");
-            std::cout << std::left << std::setw(5) << "ID" 
-                      << std::setw(15) << "First Name" 
-                      << std::setw(15) << "Last Name" 
-                      << std::setw(15) << "Nationality" << std::endl;
-            std::cout << std::string(50, '-') << std::endl;
-            for (const auto& row : directors) {
-                std::cout << std::left << std::setw(5) << row[0].c_str()
-                          << std::setw(15) << row[1].c_str()
-                          << std::setw(15) << row[2].c_str()
-                          << std::setw(15) << row[3].c_str() << std::endl;
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestDirectorsQuery>("1. Directors (режиссеры):"),
             // 2. Актеры
-            std::cout << "2. Actors (актеры):" << std::endl;
-            pqxx::result actors = txn.exec("SELECT actor_id, first_name, last_name, nationality, is_oscar_winner FROM actors ORDER BY actor_id");
-            std::cout << std::left << std::setw(5) << "ID" 
-                      << std::setw(15) << "First Name" 
-                      << std::setw(15) << "Last Name" 
-                      << std::setw(15) << "Nationality" 
-                      << std::setw(12) << "Oscar Winner" << std::endl;
-            std::cout << std::string(62, '-') << std::endl;
-            for (const auto& row : actors) {
-                std::string oscar = (row[4].c_str()[0] == 't') ? "Yes" : "No";
-                std::cout << std::left << std::setw(5) << row[0].c_str()
-                          << std::setw(15) << row[1].c_str()
-                          << std::setw(15) << row[2].c_str()
-                          << std::setw(15) << row[3].c_str()
-                          << std::setw(12) << oscar << std::endl;
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestActorsQuery>("2. Actors (актеры):"),
             // 3. Фильмы
-            std::cout << "3. Films (фильмы):" << std::endl;
-            pqxx::result films = txn.exec(
-                "SELECT f.film_id, f.title, f.release_year, f.duration_minutes, "
-                "f.budget, f.box_office, d.first_name || ' ' || d.last_name as director "
-                "FROM films f "
-                "JOIN directors d ON f.director_id = d.director_id "
-                "ORDER BY f.film_id"
-            );
-            std::cout << std::left << std::setw(5) << "ID" 
-                      << std::setw(30) << "Title" 
-                      << std::setw(8) << "Year" 
-                      << std::setw(12) << "Duration" 
-                      << std::setw(15) << "Budget" 
-                      << std::setw(15) << "Box Office" 
-                      << std::setw(20) << "Director" << std::endl;
-            std::cout << std::string(105, '-') << std::endl;
-            for (const auto& row : films) {
-                double budget = std::stod(row[4].c_str());
-                double box_office = std::stod(row[5].c_str());
-                std::cout << std::left << std::setw(5) << row[0].c_str()
-                          << std::setw(30) << row[1].c_str()
-                          << std::setw(8) << row[2].c_str()
-                          << std::setw(12) << std::string(row[3].c_str()) + " min"
-                          << std::setw(15) << std::fixed << std::setprecision(2) << "$" << budget/1000000 << "M"
-                          << std::setw(15) << "$" << box_office/1000000 << "M"
-                          << std::setw(20) << row[6].c_str() << std::endl;
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestFilmsQuery>("3. Films (фильмы):"),
             // 4. Жанры
-            std::cout << "4. Genres (жанры):" << std::endl;
-            pqxx::result genres = txn.exec("SELECT genre_id, name, description FROM genres ORDER BY genre_id");
-            std::cout << std::left << std::setw(5) << "ID" 
-                      << std::setw(15) << "Name" 
-                      << std::setw(30) << "Description" << std::endl;
-            std::cout << std::string(50, '-') << std::endl;
-            for (const auto& row : genres) {
-                std::cout << std::left << std::setw(5) << row[0].c_str()
-                          << std::setw(15) << row[1].c_str()
-                          << std::setw(30) << row[2].c_str() << std::endl;
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestGenresQuery>("4. Genres (жанры):"),
             // 5. Связи фильмов и актеров
-            std::cout << "5. Film Roles (роли актеров в фильмах):" << std::endl;
-            pqxx::result roles = txn.exec(
-                "SELECT f.title, a.first_name || ' ' || a.last_name as actor, "
-                "fr.character_name, fr.is_main_role "
-                "FROM film_roles fr "
-                "JOIN films f ON fr.film_id = f.film_id "
-                "JOIN actors a ON fr.actor_id = a.actor_id "
-                "ORDER BY f.title, fr.is_main_role DESC"
-            );
-            std::cout << std::left << std::setw(30) << "Film" 
-                      << std::setw(25) << "Actor" 
-                      << std::setw(25) << "Character" 
-                      << std::setw(12) << "Main Role" << std::endl;
-            std::cout << std::string(92, '-') << std::endl;
-            if (roles.empty()) {
-                std::cout << "No film roles found." << std::endl;
-            } else {
-                for (const auto& row : roles) {
-                    std::string is_main = (row[3].c_str()[0] == 't') ? "Yes" : "No";
-                    std::cout << std::left << std::setw(30) << row[0].c_str()
-                              << std::setw(25) << row[1].c_str()
-                              << std::setw(25) << row[2].c_str()
-                              << std::setw(12) << is_main << std::endl;
-                }
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestRolesQuery>("5. Film Roles (роли актеров в фильмах):", "No film roles found."),
             // 6. Отзывы
-            std::cout << "6. Reviews (отзывы):" << std::endl;
-            pqxx::result reviews = txn.exec(
-                "SELECT f.title, r.reviewer_name, r.rating, r.comment "
-                "FROM reviews r "
-                "JOIN films f ON r.film_id = f.film_id "
-                "ORDER BY f.title, r.rating DESC"
-            );
-            std::cout << std::left << std::setw(30) << "Film" 
-                      << std::setw(15) << "Reviewer" 
-                      << std::setw(10) << "Rating" 
-                      << std::setw(30) << "Comment" << std::endl;
-            std::cout << std::string(85, '-') << std::endl;
-            if (reviews.empty()) {
-                std::cout << "No reviews found." << std::endl;
-            } else {
-                for (const auto& row : reviews) {
-                    std::cout << std::left << std::setw(30) << row[0].c_str()
-                              << std::setw(15) << row[1].c_str()
-                              << std::setw(10) << row[2].c_str()
-                              << std::setw(30) << row[3].c_str() << std::endl;
-                }
-            }
-            std::cout << std::endl;
-            
+            tableSection<TestReviewsQuery>("6. Reviews (отзывы):", "No reviews found."),
             // 7. Сводная статистика
-            std::cout << "7. Summary Statistics (сводная статистика):" << std::endl;
-            pqxx::result stats = txn.exec(
-                "SELECT 'Directors' as category, COUNT(*)::text as count FROM directors "
-                "UNION ALL SELECT 'Actors', COUNT(*)::text FROM actors "
-                "UNION ALL SELECT 'Films', COUNT(*)::text FROM films "
-                "UNION ALL SELECT 'Genres', COUNT(*)::text FROM genres "
-                "UNION ALL SELECT 'Film Roles', COUNT(*)::text FROM film_roles "
-                "UNION ALL SELECT 'Reviews', COUNT(*)::text FROM reviews "
-                "UNION ALL SELECT 'Awards', COUNT(*)::text FROM awards "
-                "ORDER BY category"
-            );
-            std::cout << std::left << std::setw(15) << "Category" 
-                      << std::setw(10) << "Count" << std::endl;
-            std::cout << std::string(25, '-') << std::endl;
-            for (const auto& row : stats) {
-                std::cout << std::left << std::setw(15) << row[0].c_str()
-                          << std::setw(10) << row[1].c_str() << std::endl;
-            }
-            
-        } catch (const std::exception &e) {
-            std::cerr << "Error showing test data: " << e.what() << std::endl;
-        }
+            tableSection<TestSummaryQuery>("7. Summary Statistics (сводная статистика):")
+        };
+        
+        std::cout << "\n=== Test Data Overview ===\n" << std::endl;
+        runReport(account, sections, "Error showing test data");
     }
     
     // 2. Поиск фильмов по году выпуска
     void findFilmsByYear(int year) {
+        CallRecord call(recorder.get(), CallMethod::FindFilmsByYear, {year});
+        MemoryAccount account(memory, CallMethod::FindFilmsByYear);
         try {
-            pqxx::work txn(*conn);
-            std::string query = "SELECT f.film_id, f.title, f.release_year, f.duration_minutes, "
-                               "d.first_name || ' ' || d.last_name as director "
-                               "FROM films f "
-                               "LEFT JOIN directors d ON f.director_id = d.director_id "
-                               "WHERE f.release_year = $1 "
-                               "ORDER BY f.title";
-            pqxx::result r = txn.exec_params(query, year);
-            
             std::cout << "\n=== Films released in " << year << " ===" << std::endl;
-            if (r.empty()) {
+            TablePrinter<FilmsByYearQuery> films(std::cout);
+            fetchOrStream(account, FilmsByYearQuery::name, films, year);
+            if (films.rowCount() == 0) {
                 std::cout << "No films found." << std::endl;
                 return;
             }
             
-            std::cout << std::left << std::setw(5) << "ID" 
-                      << std::setw(40) << "Title" 
-                      << std::setw(10) << "Duration" 
-                      << std::setw(25) << "Director" << std::endl;
-            std::cout << std::string(80, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                std::cout << std::left << std::setw(5) << row[0].c_str()
-                          << std::setw(40) << row[1].c_str()
-                          << std::setw(10) << std::string(row[3].c_str()) + " min"
-                          << std::setw(25) << row[4].c_str() << std::endl;
-            }
-            
-            std::cout << "\nTotal films: " << r.size() << std::endl;
+            std::cout << "\nTotal films: " << films.rowCount() << std::endl;
             
         } catch (const std::exception &e) {
-            std::cerr << "Error searching films: " << e.what() << std::endl;
+            reportError("Error searching films", e);
         }
     }
     
     // 3. Получение статистики по режиссерам
     void getDirectorStatistics() {
+        CallRecord call(recorder.get(), CallMethod::GetDirectorStatistics);
+        MemoryAccount account(memory, CallMethod::GetDirectorStatistics);
         try {
-            pqxx::work txn(*conn);
-            std::string query = "SELECT d.director_id, d.first_name || ' ' || d.last_name as director_name, "
-                               "COUNT(f.film_id) as film_count, "
-                               "SUM(f.box_office) as total_box_office, "
-                               "AVG(f.box_office) as avg_box_office "
-                               "FROM directors d "
-                               "LEFT JOIN films f ON d.director_id = f.director_id "
-                               "GROUP BY d.director_id, director_name "
-                               "HAVING COUNT(f.film_id) > 0 "
-                               "ORDER BY total_box_office DESC NULLS LAST";
-            
-            pqxx::result r = txn.exec(query);
-            
             std::cout << "\n=== Director Statistics ===" << std::endl;
-            if (r.empty()) {
+            // Суммы без фильмов (NULL) печатаются как N/A
+            TablePrinter<DirectorStatsQuery> directors(std::cout);
+            fetchOrStream(account, DirectorStatsQuery::name, directors);
+            if (directors.rowCount() == 0) {
                 std::cout << "No directors found." << std::endl;
-                return;
-            }
-            
-            std::cout << std::left << std::setw(25) << "Director" 
-                      << std::setw(10) << "Films" 
-                      << std::setw(15) << "Total Box Office" 
-                      << std::setw(15) << "Average" << std::endl;
-            std::cout << std::string(65, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                std::cout << std::left << std::setw(25) << row[1].c_str()
-                          << std::setw(10) << row[2].c_str();
-                
-                if (!row[3].is_null()) {
-                    double total = std::stod(row[3].c_str());
-                    std::cout << std::setw(15) << std::fixed << std::setprecision(2) 
-                            << "$" << total/1000000 << "M";
-                } else {
-                    std::cout << std::setw(15) << "N/A";
-                }
-                
-                if (!row[4].is_null()) {
-                    double avg = std::stod(row[4].c_str());
-                    std::cout << std::setw(15) << std::fixed << std::setprecision(2) 
-                            << "$" << avg/1000000 << "M" << std::endl;
-                } else {
-                    std::cout << std::setw(15) << "N/A" << std::endl;
-                }
             }
             
         } catch (const std::exception &e) {
-            std::cerr << "Error getting statistics: " << e.what() << std::endl;
+            reportError("Error getting statistics", e);
         }
     }
     
     // 4. Поиск актеров по фильму (исправленная версия)
     void findActorsByFilm(const std::string& film_title) {
+        CallRecord call(recorder.get(), CallMethod::FindActorsByFilm, {film_title});
+        MemoryAccount account(memory, CallMethod::FindActorsByFilm);
         try {
-            pqxx::work txn(*conn);
-            
-            std::string query = "SELECT a.actor_id, a.first_name || ' ' || a.last_name as actor_name, "
-                               "fr.character_name, fr.is_main_role "
-                               "FROM film_roles fr "
-                               "JOIN actors a ON fr.actor_id = a.actor_id "
-                               "JOIN films f ON fr.film_id = f.film_id "
-                               "WHERE LOWER(f.title) LIKE LOWER('%' || $1 || '%') "
-                               "ORDER BY fr.is_main_role DESC, a.last_name";
-            
-            pqxx::result r = txn.exec_params(query, film_title);
-            
             std::cout << "\n=== Actors in films matching \"" << film_title << "\" ===" << std::endl;
-            if (r.empty()) {
+            TablePrinter<ActorsByFilmQuery> actors(std::cout);
+            fetchOrStream(account, ActorsByFilmQuery::name, actors, film_title);
+            if (actors.rowCount() == 0) {
                 std::cout << "No actors found for films matching this title." << std::endl;
                 return;
             }
             
-            std::cout << std::left << std::setw(25) << "Actor" 
-                      << std::setw(25) << "Character" 
-                      << std::setw(10) << "Main Role" << std::endl;
-            std::cout << std::string(60, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                std::string is_main = (row[3].c_str()[0] == 't') ? "Yes" : "No";
-                std::cout << std::left << std::setw(25) << row[1].c_str()
-                          << std::setw(25) << row[2].c_str()
-                          << std::setw(10) << is_main << std::endl;
-            }
-            
-            std::cout << "\nTotal actors found: " << r.size() << std::endl;
+            std::cout << "\nTotal actors found: " << actors.rowCount() << std::endl;
             
         } catch (const std::exception &e) {
-            std::cerr << "Error finding actors: " << e.what() << std::endl;
+            reportError("Error finding actors", e);
         }
     }
     
     // 5. Получение топ фильмов по кассовым сборам
     void getTopGrossingFilms(int limit = 10) {
+        CallRecord call(recorder.get(), CallMethod::GetTopGrossingFilms, {limit});
+        MemoryAccount account(memory, CallMethod::GetTopGrossingFilms);
         try {
-            pqxx::work txn(*conn);
-            std::string query = "SELECT f.title, f.release_year, f.box_office, "
-                               "d.first_name || ' ' || d.last_name as director, "
-                               "ROUND((f.box_office - f.budget) / f.budget * 100, 2) as roi "
-                               "FROM films f "
-                               "JOIN directors d ON f.director_id = d.director_id "
-                               "WHERE f.box_office > 0 AND f.budget > 0 "
-                               "ORDER BY f.box_office DESC "
-                               "LIMIT $1";
-            
-            pqxx::result r = txn.exec_params(query, limit);
+            // Топ из памяти покрывает limit до leaderboard.maxK(), больший идет в базу
+            if (limit < 0 || static_cast<size_t>(limit) > leaderboard.maxK()) {
+                printTopGrossingFromDatabase(account, limit);
+                return;
+            }
+            std::vector<TopGrossingLeaderboard::Entry> films = topGrossing(limit);
+            account.setCache(leaderboard.memoryBytes());
             
             std::cout << "\n=== Top " << limit << " Grossing Films ===" << std::endl;
-            if (r.empty()) {
+            if (films.empty()) {
                 std::cout << "No films found." << std::endl;
                 return;
             }
             
-            std::cout << std::left << std::setw(35) << "Title" 
-                      << std::setw(8) << "Year" 
-                      << std::setw(15) << "Box Office" 
-                      << std::setw(20) << "Director" 
-                      << std::setw(10) << "ROI %" << std::endl;
-            std::cout << std::string(88, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                double box_office = std::stod(row[2].c_str());
-                std::cout << std::left << std::setw(35) << row[0].c_str()
-                          << std::setw(8) << row[1].c_str()
-                          << std::setw(15) << std::fixed << std::setprecision(2) 
-                          << "$" << box_office/1000000 << "M"
-                          << std::setw(20) << row[3].c_str()
-                          << std::setw(10) << row[4].c_str() << std::endl;
+            // Строки из памяти печатаются по тем же колонкам, что и top_grossing
+            using TopGrossing = Table<TopGrossingQuery>;
+            TopGrossing::header(std::cout);
+            for (const auto& film : films) {
+                double roi = (film.box_office - film.budget) / film.budget * 100;
+                TopGrossing::render(std::cout, TopGrossing::Row(film.title, film.release_year,
+                                                                film.box_office, film.director, roi));
             }
             
         } catch (const std::exception &e) {
-            std::cerr << "Error getting top films: " << e.what() << std::endl;
+            reportError("Error getting top films", e);
         }
     }
     
@@ -374,430 +4354,662 @@ public:
     void addActor(const std::string& first_name, const std::string& last_name, 
                   const std::string& birth_date, const std::string& nationality, 
                   bool oscar_winner = false) {
+        CallRecord call(recorder.get(), CallMethod::AddActor,
+                        {first_name, last_name, birth_date, nationality, oscar_winner});
         try {
-            pqxx::work txn(*conn);
-            std::string query = "INSERT INTO actors (first_name, last_name, birth_date, nationality, is_oscar_winner) "
-                               "VALUES ($1, $2, $3, $4, $5) RETURNING actor_id";
-            pqxx::result r = txn.exec_params(query, first_name, last_name, 
-                                            birth_date, nationality, oscar_winner);
-            txn.commit();
+            pqxx::result r = write([&](pqxx::transaction_base& txn) {
+                return txn.exec_prepared("add_actor", first_name, last_name, 
+                                         birth_date, nationality, oscar_winner);
+            });
             std::cout << "Actor added successfully! Actor ID: " << r[0][0].as<int>() << std::endl;
         } catch (const std::exception &e) {
-            std::cerr << "Error adding actor: " << e.what() << std::endl;
+            reportError("Error adding actor", e);
         }
     }
     
     // 7. Поиск фильмов по жанру
     void findFilmsByGenre(const std::string& genre) {
+        CallRecord call(recorder.get(), CallMethod::FindFilmsByGenre, {genre});
+        MemoryAccount account(memory, CallMethod::FindFilmsByGenre);
         try {
-            pqxx::work txn(*conn);
-            std::string query = "SELECT f.title, f.release_year, f.duration_minutes, "
-                               "STRING_AGG(g.name, ', ') as genres "
-                               "FROM films f "
-                               "JOIN film_genres fg ON f.film_id = fg.film_id "
-                               "JOIN genres g ON fg.genre_id = g.genre_id "
-                               "WHERE LOWER(g.name) LIKE LOWER('%' || $1 || '%') "
-                               "GROUP BY f.film_id, f.title, f.release_year, f.duration_minutes "
-                               "ORDER BY f.release_year DESC";
-            
-            pqxx::result r = txn.exec_params(query, genre);
-            
             std::cout << "\n=== Films in genre: " << genre << " ===" << std::endl;
-            if (r.empty()) {
+            TablePrinter<FilmsByGenreQuery> films(std::cout);
+            fetchOrStream(account, FilmsByGenreQuery::name, films, genre);
+            if (films.rowCount() == 0) {
                 std::cout << "No films found." << std::endl;
-                return;
-            }
-            
-            std::cout << std::left << std::setw(35) << "Title" 
-                      << std::setw(8) << "Year" 
-                      << std::setw(10) << "Duration" 
-                      << std::setw(25) << "Genres" << std::endl;
-            std::cout << std::string(78, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                std::cout << std::left << std::setw(35) << row[0].c_str()
-                          << std::setw(8) << row[1].c_str()
-                          << std::setw(10) << std::string(row[2].c_str()) + " min"
-                          << std::setw(25) << row[3].c_str() << std::endl;
             }
             
         } catch (const std::exception &e) {
-            std::cerr << "Error searching by genre: " << e.what() << std::endl;
+            reportError("Error searching by genre", e);
         }
     }
     
     // 8. Получение среднего рейтинга фильмов
     void getAverageFilmRatings() {
+        CallRecord call(recorder.get(), CallMethod::GetAverageFilmRatings);
+        MemoryAccount account(memory, CallMethod::GetAverageFilmRatings);
         try {
-            pqxx::work txn(*conn);
-            std::string query = "SELECT f.title, "
-                               "ROUND(AVG(r.rating), 2) as avg_rating, "
-                               "COUNT(r.review_id) as review_count "
-                               "FROM films f "
-                               "LEFT JOIN reviews r ON f.film_id = r.film_id "
-                               "GROUP BY f.film_id, f.title "
-                               "HAVING COUNT(r.review_id) >= 1 "
-                               "ORDER BY avg_rating DESC";
+            // Рейтинги берутся из скользящих агрегатов, а не из AVG по reviews
+            seedFilmRatings(false, &account);
+            account.setCache(film_ratings.memoryBytes());
+            std::map<int, RatingAggregates::FilmRating> films = film_ratings.snapshot();
+            
+            std::vector<int> untitled;
+            for (const auto& film : films) {
+                if (film.second.title.empty()) {
+                    untitled.push_back(film.first);
+                }
+            }
+            if (!untitled.empty()) {
+                using Titles = Table<FilmTitlesQuery>;
+                for (const auto& result_row : query(FilmTitlesQuery::name, intArray(untitled))) {
+                    Titles::Row row = Titles::decode(result_row);
+                    int film_id = std::get<Titles::index("film_id")>(row);
+                    const std::string& title = std::get<Titles::index("title")>(row);
+                    films[film_id].title = title;
+                    film_ratings.setTitle(film_id, title);
+                }
+            }
             
-            pqxx::result r = txn.exec(query);
+            std::vector<const RatingAggregates::FilmRating*> rated;
+            for (const auto& film : films) {
+                if (film.second.count >= 1) {
+                    rated.push_back(&film.second);
+                }
+            }
+            std::sort(rated.begin(), rated.end(), [](const auto* a, const auto* b) {
+                return a->sum / a->count > b->sum / b->count;
+            });
             
             std::cout << "\n=== Average Film Ratings ===" << std::endl;
-            if (r.empty()) {
+            if (rated.empty()) {
                 std::cout << "No ratings found." << std::endl;
                 return;
             }
             
-            std::cout << std::left << std::setw(35) << "Title" 
-                      << std::setw(12) << "Avg Rating" 
-                      << std::setw(12) << "Reviews" << std::endl;
-            std::cout << std::string(59, '-') << std::endl;
-            
-            for (const auto& row : r) {
-                std::cout << std::left << std::setw(35) << row[0].c_str()
-                          << std::setw(12) << row[1].c_str()
-                          << std::setw(12) << row[2].c_str() << std::endl;
+            // Агрегаты печатаются по колонкам запроса avg_ratings
+            using Ratings = Table<AvgRatingsQuery>;
+            Ratings::header(std::cout);
+            for (const auto* film : rated) {
+                Ratings::render(std::cout, Ratings::Row(film->title, film->sum / film->count, film->count));
             }
             
         } catch (const std::exception &e) {
-            std::cerr << "Error getting ratings: " << e.what() << std::endl;
+            reportError("Error getting ratings", e);
+        }
+    }
+    
+    // Добавление отзыва: запись идет в фоне через конвейер приема отзывов
+    void addReview(int film_id, const std::string& reviewer_name, double rating,
+                   const std::string& comment) {
+        CallRecord call(recorder.get(), CallMethod::AddReview, {film_id, reviewer_name, rating, comment});
+        try {
+            reviewIngestion().submit({film_id, reviewer_name, rating, comment});
+            std::cout << "Review queued for ingestion!" << std::endl;
+        } catch (const std::exception &e) {
+            reportError("Error adding review", e);
         }
     }
     
     // 9. Добавление нового фильма
     void addFilm(const std::string& title, int release_year, int duration, 
                  double budget, double box_office, int director_id) {
+        CallRecord call(recorder.get(), CallMethod::AddFilm,
+                        {title, release_year, duration, budget, box_office, director_id});
         try {
-            pqxx::work txn(*conn);
-            std::string query = "INSERT INTO films (title, release_year, duration_minutes, budget, box_office, director_id) "
-                               "VALUES ($1, $2, $3, $4, $5, $6) RETURNING film_id";
-            pqxx::result r = txn.exec_params(query, title, release_year, duration, 
-                                             budget, box_office, director_id);
-            txn.commit();
-            std::cout << "Film added successfully! Film ID: " << r[0][0].as<int>() << std::endl;
+            pqxx::result r = write([&](pqxx::transaction_base& txn) {
+                return txn.exec_prepared("add_film", title, release_year, duration, 
+                                         budget, box_office, director_id);
+            });
+            int film_id = r[0][0].as<int>();
+            std::cout << "Film added successfully! Film ID: " << film_id << std::endl;
+            refreshLeaderboardFilms({film_id});
         } catch (const std::exception &e) {
-            std::cerr << "Error adding film: " << e.what() << std::endl;
+            reportError("Error adding film", e);
         }
     }
     
     // 10. Обновление информации о фильме
     void updateFilmBoxOffice(int film_id, double new_box_office) {
+        CallRecord call(recorder.get(), CallMethod::UpdateFilmBoxOffice, {film_id, new_box_office});
         try {
-            pqxx::work txn(*conn);
-            std::string query = "UPDATE films SET box_office = $1 WHERE film_id = $2";
-            txn.exec_params(query, new_box_office, film_id);
-            txn.commit();
+            // Сборы обновляются часто и некритичны: фиксация без ожидания WAL
+            write([&](pqxx::transaction_base& txn) {
+                return txn.exec_prepared("update_box_office", new_box_office, film_id);
+            }, Durability::Async);
             std::cout << "Film box office updated successfully!" << std::endl;
+            if (!leaderboard.updateBoxOffice(film_id, new_box_office)) {
+                refreshLeaderboardFilms({film_id});
+            }
         } catch (const std::exception &e) {
-            std::cerr << "Error updating film: " << e.what() << std::endl;
+            reportError("Error updating film", e);
         }
     }
     
     // 11. Метод для демонстрации всех 10 запросов
     void demonstrateAllQueries() {
-        std::cout << "\n=== Demonstrating All 10 Required SQL Queries ===" << std::endl;
-        
-        try {
-            pqxx::work txn(*conn);
-            
-            // Запрос 1: SELECT с JOIN и WHERE
-            std::cout << "\n1. Films by director Christopher Nolan:" << std::endl;
-            pqxx::result r1 = txn.exec(
-                "SELECT f.title, f.release_year, f.budget, f.box_office "
-                "FROM films f "
-                "JOIN directors d ON f.director_id = d.director_id "
-                "WHERE d.first_name = 'Christopher' AND d.last_name = 'Nolan'"
-            );
-            if (r1.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (const auto& row : r1) {
-                    std::cout << "  " << row[0].c_str() << " (" 
-                             << row[1].c_str() << ")" << std::endl;
+        CallRecord call(recorder.get(), CallMethod::DemonstrateAllQueries);
+        MemoryAccount account(memory, CallMethod::DemonstrateAllQueries);
+        std::vector<ReportSection> sections = {
+            {DemoNolanFilmsQuery::name, {[](const ChunkedResult& r1, std::ostream& out) {
+                // Запрос 1: SELECT с JOIN и WHERE
+                using Films = Table<DemoNolanFilmsQuery>;
+                out << "\n1. Films by director Christopher Nolan:" << std::endl;
+                if (r1.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (const auto& result_row : r1) {
+                        Films::Row row = Films::decode(result_row);
+                        out << "  " << Films::text<Films::index("title")>(row) << " (" 
+                           << Films::text<Films::index("release_year")>(row) << ")" << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 2: SELECT с агрегатной функцией и GROUP BY
-            std::cout << "\n2. Average budget by release year:" << std::endl;
-            pqxx::result r2 = txn.exec(
-                "SELECT release_year, AVG(budget) as avg_budget, COUNT(*) as film_count "
-                "FROM films "
-                "GROUP BY release_year "
-                "HAVING COUNT(*) > 0 "
-                "ORDER BY release_year DESC"
-            );
-            if (r2.empty()) {
-                std::cout << "  No data found." << std::endl;
-            } else {
-                for (const auto& row : r2) {
-                    double avg = std::stod(row[1].c_str());
-                    std::cout << "  " << row[0].c_str() << ": $" 
-                             << std::fixed << std::setprecision(2) << avg/1000000 
-                             << "M (" << row[2].c_str() << " films)" << std::endl;
+            }}},
+            {DemoAvgBudgetQuery::name, {[](const ChunkedResult& r2, std::ostream& out) {
+                // Запрос 2: SELECT с агрегатной функцией и GROUP BY
+                using Years = Table<DemoAvgBudgetQuery>;
+                out << "\n2. Average budget by release year:" << std::endl;
+                if (r2.empty()) {
+                    out << "  No data found." << std::endl;
+                } else {
+                    for (const auto& result_row : r2) {
+                        Years::Row row = Years::decode(result_row);
+                        out << "  " << Years::text<Years::index("release_year")>(row) << ": " 
+                           << Years::text<Years::index("avg_budget")>(row) 
+                           << " (" << Years::text<Years::index("film_count")>(row) << " films)" << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 3: SELECT с подзапросом
-            std::cout << "\n3. Films with above average box office:" << std::endl;
-            pqxx::result r3 = txn.exec(
-                "SELECT title, box_office "
-                "FROM films "
-                "WHERE box_office > (SELECT AVG(box_office) FROM films) "
-                "ORDER BY box_office DESC"
-            );
-            if (r3.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (const auto& row : r3) {
-                    double box = std::stod(row[1].c_str());
-                    std::cout << "  " << row[0].c_str() << ": $" 
-                             << std::fixed << std::setprecision(2) << box/1000000 
-                             << "M" << std::endl;
+            }}},
+            {DemoAboveAvgQuery::name, {[](const ChunkedResult& r3, std::ostream& out) {
+                // Запрос 3: SELECT с подзапросом
+                using Films = Table<DemoAboveAvgQuery>;
+                out << "\n3. Films with above average box office:" << std::endl;
+                if (r3.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (const auto& result_row : r3) {
+                        Films::Row row = Films::decode(result_row);
+                        out << "  " << Films::text<Films::index("title")>(row) << ": " 
+                           << Films::text<Films::index("box_office")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 4: SELECT с LEFT JOIN
-            std::cout << "\n4. All directors with their film count:" << std::endl;
-            pqxx::result r4 = txn.exec(
-                "SELECT d.first_name || ' ' || d.last_name as director, "
-                "COUNT(f.film_id) as film_count "
-                "FROM directors d "
-                "LEFT JOIN films f ON d.director_id = f.director_id "
-                "GROUP BY d.director_id "
-                "ORDER BY film_count DESC"
-            );
-            if (r4.empty()) {
-                std::cout << "  No directors found." << std::endl;
-            } else {
-                for (const auto& row : r4) {
-                    std::cout << "  " << row[0].c_str() << ": " 
-                             << row[1].c_str() << " films" << std::endl;
+            }}},
+            {DemoDirectorCountsQuery::name, {[](const ChunkedResult& r4, std::ostream& out) {
+                // Запрос 4: SELECT с LEFT JOIN
+                using Directors = Table<DemoDirectorCountsQuery>;
+                out << "\n4. All directors with their film count:" << std::endl;
+                if (r4.empty()) {
+                    out << "  No directors found." << std::endl;
+                } else {
+                    for (const auto& result_row : r4) {
+                        Directors::Row row = Directors::decode(result_row);
+                        out << "  " << Directors::text<Directors::index("director")>(row) << ": " 
+                           << Directors::text<Directors::index("film_count")>(row) << " films" << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 5: SELECT с INNER JOIN и ORDER BY
-            std::cout << "\n5. Films with their genres:" << std::endl;
-            pqxx::result r5 = txn.exec(
-                "SELECT f.title, STRING_AGG(g.name, ', ') as genres "
-                "FROM films f "
-                "JOIN film_genres fg ON f.film_id = fg.film_id "
-                "JOIN genres g ON fg.genre_id = g.genre_id "
-                "GROUP BY f.film_id, f.title "
-                "ORDER BY f.title"
-            );
-            if (r5.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (const auto& row : r5) {
-                    std::cout << "  " << row[0].c_str() << ": " 
-                             << row[1].c_str() << std::endl;
+            }}},
+            {DemoFilmGenresQuery::name, {[](const ChunkedResult& r5, std::ostream& out) {
+                // Запрос 5: SELECT с INNER JOIN и ORDER BY
+                using Films = Table<DemoFilmGenresQuery>;
+                out << "\n5. Films with their genres:" << std::endl;
+                if (r5.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (const auto& result_row : r5) {
+                        Films::Row row = Films::decode(result_row);
+                        out << "  " << Films::text<Films::index("title")>(row) << ": " 
+                           << Films::text<Films::index("genres")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 6: SELECT с LIMIT и OFFSET
-            std::cout << "\n6. Top 3 highest grossing films:" << std::endl;
-            pqxx::result r6 = txn.exec(
-                "SELECT title, box_office "
-                "FROM films "
-                "ORDER BY box_office DESC "
-                "LIMIT 3"
-            );
-            if (r6.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (int i = 0; i < r6.size(); i++) {
-                    double box = std::stod(r6[i][1].c_str());
-                    std::cout << "  " << (i+1) << ". " << r6[i][0].c_str() 
-                             << ": $" << std::fixed << std::setprecision(2) 
-                             << box/1000000 << "M" << std::endl;
+            }}},
+            {DemoTop3Query::name, {[](const ChunkedResult& r6, std::ostream& out) {
+                // Запрос 6: SELECT с LIMIT и OFFSET
+                using Films = Table<DemoTop3Query>;
+                out << "\n6. Top 3 highest grossing films:" << std::endl;
+                if (r6.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (size_t i = 0; i < r6.size(); i++) {
+                        Films::Row row = Films::decode(r6[i]);
+                        out << "  " << (i+1) << ". " << Films::text<Films::index("title")>(row) 
+                           << ": " << Films::text<Films::index("box_office")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 7: SELECT с CASE
-            std::cout << "\n7. Film profitability analysis:" << std::endl;
-            pqxx::result r7 = txn.exec(
-                "SELECT title, budget, box_office, "
-                "CASE "
-                "  WHEN box_office > budget * 5 THEN 'Blockbuster' "
-                "  WHEN box_office > budget * 2 THEN 'Successful' "
-                "  WHEN box_office > budget THEN 'Profitable' "
-                "  ELSE 'Unprofitable' "
-                "END as profitability "
-                "FROM films "
-                "ORDER BY box_office DESC"
-            );
-            if (r7.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (const auto& row : r7) {
-                    std::cout << "  " << row[0].c_str() << ": " 
-                             << row[3].c_str() << std::endl;
+            }}},
+            {DemoProfitabilityQuery::name, {[](const ChunkedResult& r7, std::ostream& out) {
+                // Запрос 7: SELECT с CASE
+                using Films = Table<DemoProfitabilityQuery>;
+                out << "\n7. Film profitability analysis:" << std::endl;
+                if (r7.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (const auto& result_row : r7) {
+                        Films::Row row = Films::decode(result_row);
+                        out << "  " << Films::text<Films::index("title")>(row) << ": " 
+                           << Films::text<Films::index("profitability")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 8: SELECT с оконной функцией
-            std::cout << "\n8. Films ranked within their release year:" << std::endl;
-            pqxx::result r8 = txn.exec(
-                "SELECT title, release_year, box_office, "
-                "RANK() OVER (PARTITION BY release_year ORDER BY box_office DESC) as yearly_rank "
-                "FROM films "
-                "ORDER BY release_year, yearly_rank"
-            );
-            if (r8.empty()) {
-                std::cout << "  No films found." << std::endl;
-            } else {
-                for (const auto& row : r8) {
-                    std::cout << "  " << row[0].c_str() << " (" 
-                             << row[1].c_str() << "): Rank " 
-                             << row[3].c_str() << std::endl;
+            }}},
+            {DemoYearlyRankQuery::name, {[](const ChunkedResult& r8, std::ostream& out) {
+                // Запрос 8: SELECT с оконной функцией
+                using Films = Table<DemoYearlyRankQuery>;
+                out << "\n8. Films ranked within their release year:" << std::endl;
+                if (r8.empty()) {
+                    out << "  No films found." << std::endl;
+                } else {
+                    for (const auto& result_row : r8) {
+                        Films::Row row = Films::decode(result_row);
+                        out << "  " << Films::text<Films::index("title")>(row) << " (" 
+                           << Films::text<Films::index("release_year")>(row) << "): Rank " 
+                           << Films::text<Films::index("yearly_rank")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 9: SELECT с UNION
-            std::cout << "\n9. All people in cinema (directors and actors):" << std::endl;
-            pqxx::result r9 = txn.exec(
-                "SELECT first_name || ' ' || last_name as name, 'Director' as role "
-                "FROM directors "
-                "UNION "
-                "SELECT first_name || ' ' || last_name as name, 'Actor' as role "
-                "FROM actors "
-                "ORDER BY name "
-                "LIMIT 5"
-            );
-            if (r9.empty()) {
-                std::cout << "  No people found." << std::endl;
-            } else {
-                for (const auto& row : r9) {
-                    std::cout << "  " << row[0].c_str() << " - " 
-                             << row[1].c_str() << std::endl;
+            }}},
+            {DemoPeopleQuery::name, {[](const ChunkedResult& r9, std::ostream& out) {
+                // Запрос 9: SELECT с UNION
+                using People = Table<DemoPeopleQuery>;
+                out << "\n9. All people in cinema (directors and actors):" << std::endl;
+                if (r9.empty()) {
+                    out << "  No people found." << std::endl;
+                } else {
+                    for (const auto& result_row : r9) {
+                        People::Row row = People::decode(result_row);
+                        out << "  " << People::text<People::index("name")>(row) << " - " 
+                           << People::text<People::index("role")>(row) << std::endl;
+                    }
                 }
-            }
-            
-            // Запрос 10: SELECT с EXISTS
-            std::cout << "\n10. Directors who have won awards:" << std::endl;
-            pqxx::result r10 = txn.exec(
-                "SELECT d.first_name || ' ' || d.last_name as director "
-                "FROM directors d "
-                "WHERE EXISTS ("
-                "  SELECT 1 FROM films f "
-                "  JOIN film_awards fa ON f.film_id = fa.film_id "
-                "  WHERE f.director_id = d.director_id"
-                ")"
-            );
-            if (r10.empty()) {
-                std::cout << "  No directors found." << std::endl;
-            } else {
-                for (const auto& row : r10) {
-                    std::cout << "  " << row[0].c_str() << std::endl;
+            }}},
+            {DemoAwardDirectorsQuery::name, {[](const ChunkedResult& r10, std::ostream& out) {
+                // Запрос 10: SELECT с EXISTS
+                using Directors = Table<DemoAwardDirectorsQuery>;
+                out << "\n10. Directors who have won awards:" << std::endl;
+                if (r10.empty()) {
+                    out << "  No directors found." << std::endl;
+                } else {
+                    for (const auto& result_row : r10) {
+                        Directors::Row row = Directors::decode(result_row);
+                        out << "  " << Directors::text<Directors::index("director")>(row) << std::endl;
+                    }
                 }
-            }
-            
-        } catch (const std::exception &e) {
-            std::cerr << "Error demonstrating queries: " << e.what() << std::endl;
-        }
+            }}}
+        };
+        
+        std::cout << "\n=== Demonstrating All 10 Required SQL Queries ===" << std::endl;
+        runReport(account, sections, "Error demonstrating queries");
     }
     
 
     // 13. Статистика по длительности фильмов 
     void filmDurationStatistics() {
+        CallRecord call(recorder.get(), CallMethod::FilmDurationStatistics);
+        MemoryAccount account(memory, CallMethod::FilmDurationStatistics);
+        // Таблица по категориям и список фильмов форматируются параллельно
+        std::vector<ReportSection> sections = {
+            {DurationStatsQuery::name, {
+                [](const ChunkedResult& r, std::ostream& out) {
+                    using Durations = Table<DurationStatsQuery>;
+                    if (r.empty()) {
+                        out << "No data found." << std::endl;
+                        return;
+                    }
+                    
+                    Durations::header(out);
+                    
+                    double overall_avg_rating = 0;
+                    long total_films = 0;
+                    
+                    for (const auto& result_row : r) {
+                        Durations::Row row = Durations::decode(result_row);
+                        Durations::render(out, row);
+                        
+                        long film_count = std::get<Durations::index("film_count")>(row);
+                        overall_avg_rating += std::get<Durations::index("avg_rating")>(row) * film_count;
+                        total_films += film_count;
+                    }
+                    
+                    // Общая статистика
+                    if (total_films > 0) {
+                        overall_avg_rating /= total_films;
+                        out << std::string(Durations::width, '-') << std::endl;
+                        Durations::pad<Durations::index("duration_category")>(out, "OVERALL");
+                        Durations::pad<Durations::index("film_count")>(out, std::to_string(total_films));
+                        Durations::pad<Durations::index("avg_duration")>(out, "");
+                        Durations::pad<Durations::index("avg_rating")>(out, fixedDecimal(overall_avg_rating, 2));
+                        Durations::pad<Durations::index("min_rating")>(out, "");
+                        Durations::pad<Durations::index("max_rating")>(out, "");
+                        out << std::endl;
+                    }
+                },
+                [](const ChunkedResult& r, std::ostream& out) {
+                    using Durations = Table<DurationStatsQuery>;
+                    if (r.empty()) {
+                        return;
+                    }
+                    
+                    out << "\n=== Film List by Category ===" << std::endl;
+                    for (const auto& result_row : r) {
+                        Durations::Row row = Durations::decode(result_row);
+                        out << "\n" << std::get<Durations::index("duration_category")>(row) << ":" << std::endl;
+                        out << "  Films: " << std::get<Durations::index("films")>(row) << std::endl;
+                    }
+                }
+            }}
+        };
+        
+        std::cout << "\n=== Film Duration Statistics ===" << std::endl;
+        std::cout << "Analysis of film ratings based on duration categories\n" << std::endl;
+        runReport(account, sections, "Error getting duration statistics");
+    }
+    
+    // 16. Полнотекстовый поиск по отзывам. Печатает страницу результатов,
+    // сдвигает page на следующую и возвращает false, если страниц больше нет
+    bool searchReviews(const std::string& terms, SearchPage& page, int page_size = 10) {
+        CallRecord call(recorder.get(), CallMethod::SearchReviews,
+                        {terms, page.last_rank, page.last_id, page_size, page.max_matches});
+        MemoryAccount account(memory, CallMethod::SearchReviews);
         try {
-            pqxx::work txn(*conn);
-            std::string query = 
-                "WITH duration_categories AS ("
-                "  SELECT "
-                "    f.film_id, "
-                "    f.title, "
-                "    f.duration_minutes, "
-                "    r.rating, "
-                "    CASE "
-                "      WHEN f.duration_minutes < 100 THEN 'Short (< 100 min)' "
-                "      WHEN f.duration_minutes >= 100 AND f.duration_minutes < 200 THEN 'Medium (100-200 min)' "
-                "      WHEN f.duration_minutes >= 200 THEN 'Long (≥ 200 min)' "
-                "      ELSE 'Unknown' "
-                "    END as duration_category "
-                "  FROM films f "
-                "  LEFT JOIN reviews r ON f.film_id = r.film_id "
-                ") "
-                "SELECT "
-                "  duration_category, "
-                "  COUNT(DISTINCT film_id) as film_count, "
-                " ROUND(AVG(duration_minutes)::numeric, 1) as avg_duration, "
-                " ROUND(AVG(rating)::numeric, 2) as avg_rating, "
-                "  MIN(rating) as min_rating, "
-                "  MAX(rating) as max_rating, "
-                "  STRING_AGG(DISTINCT title, ', ' ORDER BY title) as films "
-                "FROM duration_categories "
-                "GROUP BY duration_category "
-                "HAVING COUNT(DISTINCT film_id) > 0 "
-                "ORDER BY "
-                "  CASE duration_category "
-                "    WHEN 'Short (< 100 min)' THEN 1 "
-                "    WHEN 'Medium (100-200 min)' THEN 2 "
-                "    WHEN 'Long (≥ 200 min)' THEN 3 "
-                "    ELSE 4 "
-                "  END";
-            
-            pqxx::result r = txn.exec(query);
-            
-            std::cout << "\n=== Film Duration Statistics ===" << std::endl;
-            std::cout << "Analysis of film ratings based on duration categories\n" << std::endl;
+            using Reviews = Table<SearchReviewsQuery>;
+            ChunkedResult r = fetchAll(account, SearchReviewsQuery::name, terms, page.last_rank, page.last_id, page_size,
+                                       page.max_matches);
             
+            std::cout << "\n=== Reviews matching \"" << terms << "\" ===" << std::endl;
             if (r.empty()) {
-                std::cout << "No data found." << std::endl;
-                return;
+                std::cout << "No more reviews found." << std::endl;
+                return false;
             }
             
-            std::cout << std::left << std::setw(25) << "Duration Category" 
-                      << std::setw(12) << "Films" 
-                      << std::setw(15) << "Avg Duration" 
-                      << std::setw(12) << "Avg Rating" 
-                      << std::setw(12) << "Min Rating" 
-                      << std::setw(12) << "Max Rating" << std::endl;
-            std::cout << std::string(88, '-') << std::endl;
-            
-            double overall_avg_rating = 0;
-            int total_films = 0;
-            
+            Reviews::Row last;
+            Reviews::header(std::cout);
             for (const auto& row : r) {
-                int film_count = std::stoi(row[1].c_str());
-                double avg_duration = std::stod(row[2].c_str());
-                double avg_rating = row[3].is_null() ? 0 : std::stod(row[3].c_str());
-                double min_rating = row[4].is_null() ? 0 : std::stod(row[4].c_str());
-                double max_rating = row[5].is_null() ? 0 : std::stod(row[5].c_str());
-                
-                std::cout << std::left << std::setw(25) << row[0].c_str()
-                          << std::setw(12) << film_count
-                          << std::setw(15) << std::fixed << std::setprecision(1) << avg_duration << " min"
-                          << std::setw(12) << std::fixed << std::setprecision(2) << avg_rating
-                          << std::setw(12) << std::fixed << std::setprecision(2) << min_rating
-                          << std::setw(12) << std::fixed << std::setprecision(2) << max_rating << std::endl;
-                
-                overall_avg_rating += avg_rating * film_count;
-                total_films += film_count;
+                last = Reviews::decode(row);
+                Reviews::render(std::cout, last);
+            }
+            
+            page.last_rank = std::get<Reviews::index("rank")>(last);
+            page.last_id = std::get<Reviews::index("review_id")>(last);
+            page.capped = std::get<Reviews::index("capped")>(last);
+            if (page.capped) {
+                std::cout << "Ranked only the " << page.max_matches
+                          << " newest matches; older matches are not shown." << std::endl;
             }
+            return static_cast<int>(r.size()) == page_size;
+        } catch (const std::exception &e) {
+            reportError("Error searching reviews", e);
+            return false;
+        }
+    }
+    
+    // 17. Полнотекстовый поиск по названиям фильмов
+    bool searchFilms(const std::string& terms, SearchPage& page, int page_size = 10) {
+        CallRecord call(recorder.get(), CallMethod::SearchFilms,
+                        {terms, page.last_rank, page.last_id, page_size, page.max_matches});
+        MemoryAccount account(memory, CallMethod::SearchFilms);
+        try {
+            using Films = Table<SearchFilmsQuery>;
+            ChunkedResult r = fetchAll(account, SearchFilmsQuery::name, terms, page.last_rank, page.last_id, page_size,
+                                       page.max_matches);
             
-            // Общая статистика
-            if (total_films > 0) {
-                overall_avg_rating /= total_films;
-                std::cout << std::string(88, '-') << std::endl;
-                std::cout << std::left << std::setw(25) << "OVERALL"
-                          << std::setw(12) << total_films
-                          << std::setw(15) << ""
-                          << std::setw(12) << std::fixed << std::setprecision(2) << overall_avg_rating
-                          << std::setw(12) << ""
-                          << std::setw(12) << "" << std::endl;
+            std::cout << "\n=== Films matching \"" << terms << "\" ===" << std::endl;
+            if (r.empty()) {
+                std::cout << "No more films found." << std::endl;
+                return false;
             }
             
-            std::cout << "\n=== Film List by Category ===" << std::endl;
+            Films::Row last;
+            Films::header(std::cout);
             for (const auto& row : r) {
-                std::string category = row[0].c_str();
-                std::string films_list = row[6].c_str();
-                
-                std::cout << "\n" << category << ":" << std::endl;
-                std::cout << "  Films: " << films_list << std::endl;
+                last = Films::decode(row);
+                Films::render(std::cout, last);
             }
             
+            page.last_rank = std::get<Films::index("rank")>(last);
+            page.last_id = std::get<Films::index("film_id")>(last);
+            page.capped = std::get<Films::index("capped")>(last);
+            if (page.capped) {
+                std::cout << "Ranked only the " << page.max_matches
+                          << " newest matches; older matches are not shown." << std::endl;
+            }
+            return static_cast<int>(r.size()) == page_size;
+        } catch (const std::exception &e) {
+            reportError("Error searching films", e);
+            return false;
+        }
+    }
+    
+    // 14. Проверка планов запросов (EXPLAIN) относительно базовой линии
+    void inspectQueryPlans(bool save_baseline) {
+        try {
+            QueryPlanInspector inspector(database(), "query_plans.baseline");
+            inspector.run(save_baseline);
         } catch (const std::exception &e) {
-            std::cerr << "Error getting duration statistics: " << e.what() << std::endl;
+            reportError("Error inspecting query plans", e);
+        }
+    }
+    
+    // 15. Метрики времени выполнения
+    void showRuntimeMetrics() {
+        auto metric = [](const std::string& name, const auto& value) {
+            std::cout << std::left << std::setw(35) << name << std::setw(15) << value << std::endl;
+        };
+        
+        std::cout << "\n=== Runtime Metrics ===" << std::endl;
+        metric("Metric", "Value");
+        std::cout << std::string(50, '-') << std::endl;
+        metric("Read queries executed", single_flight.executedCalls());
+        metric("Read calls coalesced", single_flight.coalescedCalls());
+        metric("Read queries in flight", single_flight.inFlight());
+        metric("Leaderboard reads", leaderboard_reads.load());
+        metric("Leaderboard reseeds", leaderboard_seeds.load());
+        metric("Film change notifications", film_notifications.load());
+        metric("Review change notifications", review_notifications.load());
+        if (recorder) {
+            metric("Calls recorded", recorder->recordedCount());
+        }
+        metric("Writes committed", writes.writeCount());
+        metric("Writes failed", writes.failedCount());
+        metric("Group commits", writes.commitCount());
+        metric("Group commits without WAL wait", writes.asyncCommitCount());
+        std::lock_guard<std::mutex> lock(review_ingestion_mutex);
+        if (review_ingestion) {
+            metric("Reviews submitted", review_ingestion->submittedCount());
+            metric("Reviews written", review_ingestion->writtenCount());
+            metric("Reviews rejected", review_ingestion->rejectedCount());
+            metric("Review COPY batches", review_ingestion->batchCount());
+            metric("Review ingest rate (per sec)", static_cast<long>(review_ingestion->reviewsPerSecond()));
+        }
+        
+        std::map<CallMethod, MemoryLedger::Stats> calls = memory.snapshot();
+        if (calls.empty()) {
+            return;
+        }
+        std::cout << "\n=== Memory by Operation ===" << std::endl;
+        std::cout << std::left << std::setw(25) << "Operation" 
+                  << std::setw(8) << "Calls" 
+                  << std::setw(14) << "Peak Result" 
+                  << std::setw(14) << "Decoded" 
+                  << std::setw(14) << "Cache" 
+                  << std::setw(10) << "Streamed" 
+                  << std::setw(10) << "Rejected" 
+                  << std::setw(14) << "Budget" << std::endl;
+        std::cout << std::string(109, '-') << std::endl;
+        for (const auto& item : calls) {
+            const MemoryLedger::Stats& stats = item.second;
+            std::cout << std::left << std::setw(25) << callMethodName(item.first)
+                      << std::setw(8) << stats.calls
+                      << std::setw(14) << mebibytes(stats.peak_result_bytes)
+                      << std::setw(14) << mebibytes(stats.decoded_bytes)
+                      << std::setw(14) << mebibytes(stats.cache_bytes)
+                      << std::setw(10) << stats.streamed
+                      << std::setw(10) << stats.rejected
+                      << std::setw(14) << mebibytes(memory.budget(item.first)) << std::endl;
+        }
+    }
+};
+
+
+// Воспроизведение журнала нагрузки на N параллельных клиентах. Вывод
+// методов подавляется, в конце печатается пропускная способность и
+// хвостовые задержки по каждому методу.
+class WorkloadReplayer {
+private:
+    // Поток вывода, который все отбрасывает
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    };
+
+    static void dispatch(CinemaDatabase& db, const RecordedCall& call) {
+        const std::vector<CallArg>& a = call.args;
+        auto need = [&a](size_t count) {
+            if (a.size() < count) {
+                throw std::runtime_error("Too few arguments in workload log");
+            }
+        };
+        switch (call.method) {
+            case CallMethod::ShowTestData: db.showTestData(); break;
+            case CallMethod::FindFilmsByYear: need(1); db.findFilmsByYear(a[0].int_value); break;
+            case CallMethod::GetDirectorStatistics: db.getDirectorStatistics(); break;
+            case CallMethod::FindActorsByFilm: need(1); db.findActorsByFilm(a[0].string_value); break;
+            case CallMethod::GetTopGrossingFilms: need(1); db.getTopGrossingFilms(a[0].int_value); break;
+            case CallMethod::AddActor:
+                need(5);
+                db.addActor(a[0].string_value, a[1].string_value, a[2].string_value,
+                            a[3].string_value, a[4].int_value != 0);
+                break;
+            case CallMethod::FindFilmsByGenre: need(1); db.findFilmsByGenre(a[0].string_value); break;
+            case CallMethod::GetAverageFilmRatings: db.getAverageFilmRatings(); break;
+            case CallMethod::AddFilm:
+                need(6);
+                db.addFilm(a[0].string_value, a[1].int_value, a[2].int_value,
+                           a[3].double_value, a[4].double_value, a[5].int_value);
+                break;
+            case CallMethod::UpdateFilmBoxOffice:
+                need(2);
+                db.updateFilmBoxOffice(a[0].int_value, a[1].double_value);
+                break;
+            case CallMethod::DemonstrateAllQueries: db.demonstrateAllQueries(); break;
+            case CallMethod::FilmDurationStatistics: db.filmDurationStatistics(); break;
+            case CallMethod::AddReview:
+                need(4);
+                db.addReview(a[0].int_value, a[1].string_value, a[2].double_value, a[3].string_value);
+                break;
+            case CallMethod::SearchReviews:
+            case CallMethod::SearchFilms: {
+                need(4);
+                SearchPage page{a[1].string_value, static_cast<int>(a[2].int_value)};
+                // В журналах старого формата ограничения нет
+                page.max_matches = a.size() > 4 ? static_cast<int>(a[4].int_value) : 0;
+                if (call.method == CallMethod::SearchReviews) {
+                    db.searchReviews(a[0].string_value, page, a[3].int_value);
+                } else {
+                    db.searchFilms(a[0].string_value, page, a[3].int_value);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown method in workload log");
+        }
+    }
+
+    static double percentile(std::vector<double>& sorted, double p) {
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+public:
+    // original_timing: соблюдать интервалы между вызовами из журнала,
+    // иначе клиенты выполняют свои вызовы подряд без пауз
+    static void run(CinemaDatabase& db, const std::vector<RecordedCall>& calls,
+                    size_t clients, bool original_timing) {
+        clients = std::max<size_t>(clients, 1);
+        // Время только успешных вызовов: быстрые отказы не должны
+        // занижать перцентили, они считаются отдельно
+        std::vector<std::map<CallMethod, std::vector<double>>> latencies(clients);
+        std::vector<std::map<CallMethod, unsigned long>> failures(clients);
+
+        NullBuffer null_buffer;
+        std::streambuf* saved = std::cout.rdbuf(&null_buffer);
+        db.setRethrowErrors(true);
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t client = 0; client < clients; client++) {
+            threads.emplace_back([&, client] {
+                // Вызовы раздаются клиентам по кругу, порядок внутри клиента сохраняется
+                for (size_t i = client; i < calls.size(); i += clients) {
+                    const RecordedCall& call = calls[i];
+                    if (original_timing) {
+                        std::this_thread::sleep_until(start + std::chrono::microseconds(call.timestamp_us));
+                    }
+                    auto call_start = std::chrono::steady_clock::now();
+                    try {
+                        dispatch(db, call);
+                    } catch (const std::exception &e) {
+                        std::cerr << "Replay error in " << callMethodName(call.method) << ": " << e.what() << std::endl;
+                        failures[client][call.method]++;
+                        continue;
+                    }
+                    latencies[client][call.method].push_back(std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - call_start).count());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        db.setRethrowErrors(false);
+        std::cout.rdbuf(saved);
+
+        std::map<CallMethod, std::vector<double>> merged;
+        std::map<CallMethod, unsigned long> errors;
+        unsigned long total_errors = 0;
+        for (size_t client = 0; client < clients; client++) {
+            for (auto& entry : latencies[client]) {
+                auto& all = merged[entry.first];
+                all.insert(all.end(), entry.second.begin(), entry.second.end());
+            }
+            for (const auto& entry : failures[client]) {
+                merged[entry.first];
+                errors[entry.first] += entry.second;
+                total_errors += entry.second;
+            }
+        }
+
+        std::cout << "\n=== Workload Replay ===" << std::endl;
+        std::cout << "Calls: " << calls.size() << ", clients: " << clients
+                  << ", timing: " << (original_timing ? "original" : "as fast as possible")
+                  << ", errors: " << total_errors << std::endl;
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Elapsed: " << elapsed << " s, throughput: "
+                  << (elapsed > 0 ? calls.size() / elapsed : 0) << " calls/s\n" << std::endl;
+
+        std::cout << std::left << std::setw(25) << "Method" 
+                  << std::setw(10) << "OK" 
+                  << std::setw(10) << "Errors" 
+                  << std::setw(12) << "Calls/s" 
+                  << std::setw(12) << "p50 ms" 
+                  << std::setw(12) << "p95 ms" 
+                  << std::setw(12) << "p99 ms" 
+                  << std::setw(12) << "Max ms" << std::endl;
+        std::cout << std::string(105, '-') << std::endl;
+        for (auto& entry : merged) {
+            std::vector<double>& values = entry.second;
+            std::sort(values.begin(), values.end());
+            std::cout << std::left << std::setw(25) << callMethodName(entry.first)
+                      << std::setw(10) << values.size()
+                      << std::setw(10) << errors[entry.first]
+                      << std::setw(12) << (elapsed > 0 ? values.size() / elapsed : 0);
+            if (values.empty()) {
+                std::cout << "N/A" << std::endl;
+                continue;
+            }
+            std::cout << std::setw(12) << percentile(values, 0.50)
+                      << std::setw(12) << percentile(values, 0.95)
+                      << std::setw(12) << percentile(values, 0.99)
+                      << std::setw(12) << values.back() << std::endl;
         }
     }
 };
@@ -817,18 +5029,74 @@ void displayMenu() {
     std::cout << "10. Update film box office" << std::endl;
     std::cout << "11. Demonstrate all 10 SQL queries" << std::endl;
     std::cout << "12. Film duration statistics (CASE + агрегаты)" << std::endl;  
-    std::cout << "13. Exit" << std::endl; 
-    std::cout << "Enter your choice (1-13): ";
+    std::cout << "13. Check query plans against baseline" << std::endl;
+    std::cout << "14. Show runtime metrics" << std::endl;
+    std::cout << "15. Add review" << std::endl;
+    std::cout << "16. Search reviews" << std::endl;
+    std::cout << "17. Search films" << std::endl;
+    std::cout << "18. Exit" << std::endl; 
+    std::cout << "Enter your choice (1-18): ";
 }
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "=== Cinema Database Application ===" << std::endl;
     
+    // --fast-start          меню доступно сразу, база подключается в фоне
+    // --record FILE         записывать все вызовы в журнал нагрузки
+    // --replay FILE         воспроизвести журнал и выйти
+    // --clients N           число параллельных клиентов при воспроизведении
+    // --as-fast-as-possible воспроизводить без пауз между вызовами
+    // --memory-budget [METHOD=]MB  бюджет памяти на вызов, общий или для метода
+    bool fast_start = false;
+    bool original_timing = true;
+    size_t replay_clients = 1;
+    std::string record_path, replay_path;
+    std::vector<std::string> memory_budgets;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fast-start") {
+            fast_start = true;
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--clients" && i + 1 < argc) {
+            replay_clients = std::stoul(argv[++i]);
+        } else if (arg == "--as-fast-as-possible") {
+            original_timing = false;
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            memory_budgets.push_back(argv[++i]);
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
     // Строка подключения к базе данных
     std::string conn_string = "host=localhost port=5432 dbname=cinema_db "
                              "user=cinema_user password=cinema123";
     
     try {
-        CinemaDatabase db(conn_string);
+        CinemaDatabase db(conn_string, fast_start);
+        for (const auto& budget : memory_budgets) {
+            size_t eq = budget.find('=');
+            size_t bytes = std::stoul(budget.substr(eq == std::string::npos ? 0 : eq + 1)) * 1024 * 1024;
+            CallMethod method;
+            if (eq == std::string::npos) {
+                db.setMemoryBudget(bytes);
+            } else if (callMethodByName(budget.substr(0, eq), method)) {
+                db.setMemoryBudget(method, bytes);
+            } else {
+                std::cerr << "Unknown method in --memory-budget: " << budget.substr(0, eq) << std::endl;
+                return 1;
+            }
+        }
+        if (!replay_path.empty()) {
+            WorkloadReplayer::run(db, WorkloadRecorder::load(replay_path), replay_clients, original_timing);
+            return 0;
+        }
+        if (!record_path.empty()) {
+            db.startRecording(record_path);
+        }
         int choice;
         
         do {
@@ -932,13 +5200,62 @@ int main() {
                 case 12:
                     db.filmDurationStatistics();
                     break;
-                case 13:
+                case 13: {
+                    char save;
+                    std::cout << "Save results as new baseline? (y/n): ";
+                    std::cin >> save;
+                    db.inspectQueryPlans(save == 'y' || save == 'Y');
+                    break;
+                }
+                case 14:
+                    db.showRuntimeMetrics();
+                    break;
+                case 15: {
+                    int film_id;
+                    double rating;
+                    std::string reviewer_name, comment;
+                    
+                    std::cout << "Enter film ID: ";
+                    std::cin >> film_id;
+                    std::cin.ignore();
+                    std::cout << "Enter reviewer name: ";
+                    std::getline(std::cin, reviewer_name);
+                    std::cout << "Enter rating (0-10): ";
+                    std::cin >> rating;
+                    std::cin.ignore();
+                    std::cout << "Enter comment: ";
+                    std::getline(std::cin, comment);
+                    
+                    db.addReview(film_id, reviewer_name, rating, comment);
+                    break;
+                }
+                case 16:
+                case 17: {
+                    std::string terms;
+                    std::cout << "Enter search words: ";
+                    std::getline(std::cin, terms);
+                    
+                    SearchPage page;
+                    char more = 'y';
+                    while (more == 'y' || more == 'Y') {
+                        bool has_more = (choice == 16) ? db.searchReviews(terms, page)
+                                                       : db.searchFilms(terms, page);
+                        if (!has_more) {
+                            break;
+                        }
+                        std::cout << "Show next page? (y/n): ";
+                        std::cin >> more;
+                    }
+                    break;
+                }
+                case 18:
+                    db.saveCatalogSnapshot();
                     std::cout << "Goodbye!" << std::endl;
                     break;
                 default:
                     std::cout << "Invalid choice!" << std::endl;
             }
-        } while (choice != 13);
+        } while (choice != 18);
         
     } catch (const std::exception &e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
@@ -946,4 +5263,4 @@ int main() {
     }
     
     return 0;
-}
\ No newline at end of file
+}